@@ -38,6 +38,8 @@
 #include "display-options.h"
 #include "windows.h"
 
+#include "mount-cache.h"
+
 /* Currently open libguestfs handle. */
 guestfs_h *g;
 
@@ -50,6 +52,9 @@ int inspector = 1;
 int in_guestfish = 0;
 int in_virt_rescue = 0;
 
+static const char *cache_dir = NULL;
+static bool mounted_from_cache = false;
+
 static int do_cat (int argc, char *argv[]);
 
 static void __attribute__((noreturn))
@@ -68,6 +73,7 @@ usage (int status)
               "  -a|--add image       Add image\n"
               "  --blocksize[=512|4096]\n"
               "                       Set sector size of the disk for -a option\n"
+              "  --cache dir          Cache the guest's mountpoints in dir\n"
               "  -c|--connect uri     Specify libvirt URI for -d option\n"
               "  -d|--domain guest    Add disks from libvirt guest\n"
               "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -100,6 +106,7 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
     { "blocksize", 2, 0, 0 },
+    { "cache", 1, 0, 0 },
     { "connect", 1, 0, 'c' },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -127,6 +134,8 @@ main (int argc, char *argv[])
   int r;
   int option_index;
   struct key_store *ks = NULL;
+  CLEANUP_FREE char *cache_file = NULL;
+  CLEANUP_FREE char *type = NULL;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -152,6 +161,8 @@ main (int argc, char *argv[])
         OPTION_blocksize;
       } else if (STREQ (long_options[option_index].name, "key")) {
         OPTION_key;
+      } else if (STREQ (long_options[option_index].name, "cache")) {
+        cache_dir = optarg;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -247,6 +258,12 @@ main (int argc, char *argv[])
     usage (EXIT_FAILURE);
   }
 
+  /* With --cache, the filesystems can be mounted without inspecting
+   * the guest if it was inspected before.
+   */
+  if (cache_dir && mps == NULL && ks == NULL)
+    cache_file = mount_cache_filename (cache_dir, drvs);
+
   /* Add drives, inspect and mount. */
   add_drives (drvs);
 
@@ -258,8 +275,13 @@ main (int argc, char *argv[])
 
   if (mps != NULL)
     mount_mps (mps);
-  else
+  else if (cache_file && (type = mount_from_cache (cache_file)) != NULL)
+    mounted_from_cache = true;
+  else {
     inspect_mount ();
+    if (cache_file)
+      mount_cache_save (cache_file);
+  }
 
   /* Free up data structures, no longer needed after this point. */
   free_drives (drvs);
@@ -282,7 +304,8 @@ do_cat (int argc, char *argv[])
   char *root;
   CLEANUP_FREE_STRING_LIST char **roots = NULL;
 
-  if (inspector) {
+  /* Windows guests are never cached, see mount-cache.c. */
+  if (inspector && !mounted_from_cache) {
     /* Get root mountpoint.  See: fish/inspect.c:inspect_mount */
     roots = guestfs_inspect_get_roots (g);
 
@@ -31,3 +31,18 @@ if [ "$($VG virt-cat --format=raw -a ../test-data/phony-guests/fedora.img /etc/t
     echo "$0: error: mismatch in file test2"
     exit 1
 fi
+
+# Test --cache: the second run must mount the filesystems from the
+# cache instead of inspecting the guest, and read the same file.
+rm -rf cache.tmp
+mkdir cache.tmp
+if [ "$($VG virt-cat --cache cache.tmp --format=raw -a ../test-data/phony-guests/fedora.img /etc/test1)" != "abcdefg" ]; then
+    echo "$0: error: mismatch in file test1 with a cold cache"
+    exit 1
+fi
+if [ "$($VG virt-cat -v --cache cache.tmp --format=raw -a ../test-data/phony-guests/fedora.img /etc/test1 2>cache.log)" != "abcdefg" ]; then
+    echo "$0: error: mismatch in file test1 with a warm cache"
+    exit 1
+fi
+grep "mounted filesystems from cache" cache.log
+rm -r cache.tmp cache.log
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
@@ -28,10 +29,19 @@
 
 #include "guestfs.h"
 #include "structs-cleanups.h"
+#include "guestfs-utils.h"
 #include "options.h"
 #include "domains.h"
 #include "virt-df.h"
 
+static bool
+is_candidate (const char *fstype)
+{
+  return STRNEQ (fstype, "") &&
+    STRNEQ (fstype, "swap") &&
+    STRNEQ (fstype, "unknown");
+}
+
 /* Since we want this function to be robust against very bad failure
  * cases (hello, https://bugzilla.kernel.org/show_bug.cgi?id=18792) it
  * won't exit on guestfs failures.
@@ -39,9 +49,10 @@
 int
 df_on_handle (guestfs_h *g, const char *name, const char *uuid, FILE *fp)
 {
-  size_t i;
+  size_t i, nr_fses;
   CLEANUP_FREE_STRING_LIST char **devices = NULL;
   CLEANUP_FREE_STRING_LIST char **fses = NULL;
+  CLEANUP_FREE struct guestfs_statvfs **stats = NULL;
 
   if (verbose)
     fprintf (stderr, "df_on_handle: %s\n", name);
@@ -54,30 +65,63 @@ df_on_handle (guestfs_h *g, const char *name, const char *uuid, FILE *fp)
   if (fses == NULL)
     return -1;
 
-  for (i = 0; fses[i] != NULL; i += 2) {
-    if (STRNEQ (fses[i+1], "") &&
-        STRNEQ (fses[i+1], "swap") &&
-        STRNEQ (fses[i+1], "unknown")) {
-      const char *dev = fses[i];
-      CLEANUP_FREE_STATVFS struct guestfs_statvfs *stat = NULL;
+  nr_fses = guestfs_int_count_strings (fses) / 2;
+  stats = calloc (nr_fses, sizeof (struct guestfs_statvfs *));
+  if (stats == NULL) {
+    perror ("calloc");
+    return -1;
+  }
+
+  /* Mounting and stating the filesystems might reasonably fail, so
+   * don't show errors.
+   */
+  guestfs_push_error_handler (g, NULL, NULL);
+
+  /* Mount each filesystem on its own mountpoint and stat it, without
+   * unmounting the previous ones, so that there is only one call to
+   * umount_all for the whole guest.  The mountpoints are all at the
+   * top level, so umount_all can unmount them in any order.
+   */
+  for (i = 0; i < nr_fses; ++i) {
+    const char *dev = fses[i*2];
+    char mp[32];
+
+    if (!is_candidate (fses[i*2+1]))
+      continue;
+
+    if (verbose)
+      fprintf (stderr, "df_on_handle: %s dev %s\n", name, dev);
+
+    snprintf (mp, sizeof mp, "/%zu", i);
+    if (guestfs_mkmountpoint (g, mp) == 0 &&
+        guestfs_mount_ro (g, dev, mp) == 0)
+      stats[i] = guestfs_statvfs (g, mp);
+  }
+
+  guestfs_umount_all (g);
 
-      if (verbose)
-        fprintf (stderr, "df_on_handle: %s dev %s\n", name, dev);
+  /* Some filesystems cannot be mounted while another one is (eg. two
+   * copies of an XFS filesystem with the same UUID), so try any that
+   * failed again on their own.
+   */
+  for (i = 0; i < nr_fses; ++i) {
+    const char *dev = fses[i*2];
 
-      /* Try mounting and stating the device.  This might reasonably
-       * fail, so don't show errors.
-       */
-      guestfs_push_error_handler (g, NULL, NULL);
+    if (!is_candidate (fses[i*2+1]) || stats[i] != NULL)
+      continue;
 
-      if (guestfs_mount_ro (g, dev, "/") == 0) {
-        stat = guestfs_statvfs (g, "/");
-        guestfs_umount_all (g);
-      }
+    if (guestfs_mount_ro (g, dev, "/") == 0) {
+      stats[i] = guestfs_statvfs (g, "/");
+      guestfs_umount_all (g);
+    }
+  }
 
-      guestfs_pop_error_handler (g);
+  guestfs_pop_error_handler (g);
 
-      if (stat)
-        print_stat (fp, name, uuid, dev, stat);
+  for (i = 0; i < nr_fses; ++i) {
+    if (stats[i]) {
+      print_stat (fp, name, uuid, fses[i*2], stats[i]);
+      guestfs_free_statvfs (stats[i]);
     }
   }
 
@@ -284,24 +284,31 @@ main (int argc, char *argv[])
   else {                        /* Single guest. */
     CLEANUP_FREE char *name = NULL;
 
-    /* Add domains/drives from the command line (for a single guest). */
-    add_drives (drvs);
-
-    if (guestfs_launch (g) == -1)
-      exit (EXIT_FAILURE);
-
-    print_title ();
-
     /* Synthesize a display name. */
     name = make_display_name (drvs);
 
-    /* XXX regression: in the Perl version we cached the UUID from the
-     * libvirt domain handle so it was available to us here.  In this
-     * version the libvirt domain handle is hidden inside
-     * guestfs_add_domain so the UUID is not available easily for
-     * single '-d' command-line options.
+    /* Raw disk images containing only ext3/ext4 filesystems can be
+     * read without launching the appliance.
      */
-    err = df_on_handle (g, name, NULL, stdout);
+    if (df_from_superblocks (drvs, name, stdout) == 0)
+      err = 0;
+    else {
+      /* Add domains/drives from the command line (for a single guest). */
+      add_drives (drvs);
+
+      if (guestfs_launch (g) == -1)
+        exit (EXIT_FAILURE);
+
+      print_title ();
+
+      /* XXX regression: in the Perl version we cached the UUID from the
+       * libvirt domain handle so it was available to us here.  In this
+       * version the libvirt domain handle is hidden inside
+       * guestfs_add_domain so the UUID is not available easily for
+       * single '-d' command-line options.
+       */
+      err = df_on_handle (g, name, NULL, stdout);
+    }
 
     /* Free up data structures, no longer needed after this point. */
     free_drives (drvs);
@@ -0,0 +1,662 @@
+/* virt-df
+ * Copyright (C) 2010-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Read the filesystem usage of raw disk images directly from the
+ * host, without launching the appliance.
+ *
+ * This only handles cases where the result is certain to be the
+ * same as what statvfs returns after the appliance has mounted the
+ * filesystem: raw images with an MBR or GPT partition table (or no
+ * partition table) containing only ext3 or ext4 filesystems which
+ * were cleanly unmounted, swap partitions and BIOS boot partitions.
+ * Anything else (LVM, other filesystems, qcow2, a filesystem that
+ * needs journal recovery, ...) makes the caller fall back to the
+ * appliance for the whole guest.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <glob.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "guestfs.h"
+#include "options.h"
+#include "guestfs-utils.h"
+#include "disk-id.h"
+#include "virt-df.h"
+
+#define SECTOR_SIZE 512
+
+/* GPT partition tables normally have 128 entries.  Larger tables are
+ * left to the appliance.
+ */
+#define MAX_PARTITIONS 128
+
+struct fs {
+  char *dev;
+  struct guestfs_statvfs stat;
+};
+
+struct fs_list {
+  struct fs *fses;
+  size_t nr_fses;
+};
+
+static int
+read_at (int fd, void *buf, size_t len, uint64_t offset)
+{
+  char *p = buf;
+
+  while (len > 0) {
+    const ssize_t r = pread (fd, p, len, offset);
+    if (r <= 0)
+      return -1;
+    p += r;
+    len -= r;
+    offset += r;
+  }
+  return 0;
+}
+
+static uint64_t
+get_le (const unsigned char *p, size_t len)
+{
+  uint64_t r = 0;
+
+  while (len > 0)
+    r = (r << 8) | p[--len];
+  return r;
+}
+
+/* Superblock fields, see fs/ext4/ext4.h in Linux. */
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_SUPER_MAGIC 0xEF53
+#define EXT4_JOURNAL_INO 8
+
+#define EXT4_FEATURE_COMPAT_HAS_JOURNAL    0x0004
+#define EXT4_FEATURE_COMPAT_SPARSE_SUPER2  0x0200
+
+#define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT4_FEATURE_RO_COMPAT_BIGALLOC     0x0200
+#define EXT4_FEATURE_RO_COMPAT_ORPHAN_PRESENT 0x10000
+#define EXT4_FEATURE_RO_COMPAT_KNOWN        0x0ffff
+
+#define EXT4_FEATURE_INCOMPAT_FILETYPE   0x0002
+#define EXT4_FEATURE_INCOMPAT_RECOVER    0x0004
+#define EXT4_FEATURE_INCOMPAT_EXTENTS    0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT      0x0080
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG    0x0200
+#define EXT4_FEATURE_INCOMPAT_EA_INODE   0x0400
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED  0x2000
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR   0x4000
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA 0x8000
+#define EXT4_FEATURE_INCOMPAT_ENCRYPT    0x10000
+#define EXT4_FEATURE_INCOMPAT_CASEFOLD   0x20000
+
+/* Incompatible features which don't change how the numbers below
+ * are calculated.  In particular this excludes META_BG, which moves
+ * the group descriptors, and RECOVER, since replaying the journal
+ * changes the free counts.
+ */
+#define EXT4_FEATURE_INCOMPAT_HANDLED                                   \
+  (EXT4_FEATURE_INCOMPAT_FILETYPE|EXT4_FEATURE_INCOMPAT_EXTENTS|        \
+   EXT4_FEATURE_INCOMPAT_64BIT|EXT4_FEATURE_INCOMPAT_FLEX_BG|           \
+   EXT4_FEATURE_INCOMPAT_EA_INODE|EXT4_FEATURE_INCOMPAT_CSUM_SEED|      \
+   EXT4_FEATURE_INCOMPAT_LARGEDIR|EXT4_FEATURE_INCOMPAT_INLINE_DATA|    \
+   EXT4_FEATURE_INCOMPAT_ENCRYPT|EXT4_FEATURE_INCOMPAT_CASEFOLD)
+
+#define JBD2_MAGIC_NUMBER 0xC03B3998
+#define EXT4_EXT_MAGIC 0xF30A
+#define EXT3_JNL_BACKUP_BLOCKS 1
+
+static bool
+is_power_of (uint64_t a, uint64_t b)
+{
+  while (a > 1) {
+    if (a % b != 0)
+      return false;
+    a /= b;
+  }
+  return true;
+}
+
+/* Same as ext4_bg_has_super in Linux. */
+static bool
+ext4_bg_has_super (const unsigned char *sb, uint64_t group)
+{
+  const uint32_t compat = get_le (&sb[92], 4);
+  const uint32_t ro_compat = get_le (&sb[100], 4);
+
+  if (group == 0)
+    return true;
+  if (compat & EXT4_FEATURE_COMPAT_SPARSE_SUPER2)
+    return group == get_le (&sb[588], 4) || group == get_le (&sb[592], 4);
+  if (group <= 1 || !(ro_compat & EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER))
+    return true;
+  if (!(group & 1))
+    return false;
+  return is_power_of (group, 3) || is_power_of (group, 5) ||
+    is_power_of (group, 7);
+}
+
+/* Return the length in blocks of the internal journal, as jbd2 sees
+ * it, or 0 if it can't be found.  The location of the journal is
+ * taken from the backup of the journal inode in the superblock.
+ */
+static uint64_t
+ext4_journal_blocks (int fd, uint64_t offset, const unsigned char *sb,
+                     uint64_t block_size)
+{
+  const unsigned char *i_block = &sb[268];
+  const uint64_t i_size = get_le (&sb[268+16*4], 4) |
+    get_le (&sb[268+15*4], 4) << 32;
+  unsigned char jsb[20];
+  uint64_t start;
+
+  if (sb[253] != EXT3_JNL_BACKUP_BLOCKS)
+    return 0;
+
+  if (get_le (&i_block[0], 2) == EXT4_EXT_MAGIC) {
+    /* Extent tree, which must have the first extent in the inode. */
+    if (get_le (&i_block[2], 2) == 0 || get_le (&i_block[6], 2) != 0)
+      return 0;
+    if (get_le (&i_block[12], 4) != 0) /* First logical block. */
+      return 0;
+    start = get_le (&i_block[20], 4) | get_le (&i_block[18], 2) << 32;
+  }
+  else
+    start = get_le (&i_block[0], 4);
+
+  if (start == 0 ||
+      read_at (fd, jsb, sizeof jsb, offset + start * block_size) == -1 ||
+      get_be (&jsb[0], 4) != JBD2_MAGIC_NUMBER)
+    return 0;
+
+  /* jbd2 uses the smaller of the inode size and s_maxlen. */
+  if (get_be (&jsb[16], 4) < i_size / block_size)
+    return get_be (&jsb[16], 4);
+  return i_size / block_size;
+}
+
+/* Calculate what statvfs returns for an ext3 or ext4 filesystem
+ * mounted read-only by the ext4 driver, following ext4_statfs in
+ * Linux.  Returns 1 if this was done, or -1 if the filesystem is not
+ * ext3/ext4 or has some feature not handled here.
+ */
+static int
+ext4_statvfs (int fd, uint64_t offset, uint64_t size,
+              struct guestfs_statvfs *stat)
+{
+  unsigned char sb[1024];
+  CLEANUP_FREE unsigned char *gdt = NULL;
+  uint32_t compat, incompat, ro_compat;
+  uint64_t block_size, blocks, r_blocks, first_data_block, blocks_per_group;
+  uint64_t inodes_per_group, inode_size, desc_size, ngroups, gdb_count;
+  uint64_t itb_per_group, reserved_gdt_blocks, overhead, resv_blocks;
+  uint64_t journal_blocks;
+  uint64_t free_blocks = 0, free_inodes = 0, group;
+
+  if (read_at (fd, sb, sizeof sb, offset + EXT4_SUPERBLOCK_OFFSET) == -1 ||
+      get_le (&sb[56], 2) != EXT4_SUPER_MAGIC)
+    return -1;
+
+  compat = get_le (&sb[92], 4);
+  incompat = get_le (&sb[96], 4);
+  ro_compat = get_le (&sb[100], 4);
+
+  /* Filesystems without a journal might be mounted by the ext2
+   * driver, which calculates the overhead differently.
+   */
+  if (!(compat & EXT4_FEATURE_COMPAT_HAS_JOURNAL) ||
+      get_le (&sb[224], 4) != EXT4_JOURNAL_INO ||
+      (incompat & ~EXT4_FEATURE_INCOMPAT_HANDLED) ||
+      (ro_compat & ~EXT4_FEATURE_RO_COMPAT_KNOWN) ||
+      (ro_compat & (EXT4_FEATURE_RO_COMPAT_BIGALLOC |
+                    EXT4_FEATURE_RO_COMPAT_ORPHAN_PRESENT)) ||
+      get_le (&sb[76], 4) < 1 ||                /* s_rev_level */
+      get_le (&sb[232], 4) != 0)                /* s_last_orphan */
+    return -1;
+
+  if (get_le (&sb[24], 4) > 6)                  /* s_log_block_size */
+    return -1;
+  block_size = UINT64_C (1024) << get_le (&sb[24], 4);
+  blocks = get_le (&sb[4], 4);
+  r_blocks = get_le (&sb[8], 4);
+  if (incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+    blocks |= get_le (&sb[336], 4) << 32;
+    r_blocks |= get_le (&sb[340], 4) << 32;
+    desc_size = get_le (&sb[254], 2);
+  }
+  else
+    desc_size = 32;
+  first_data_block = get_le (&sb[20], 4);
+  blocks_per_group = get_le (&sb[32], 4);
+  inodes_per_group = get_le (&sb[40], 4);
+  inode_size = get_le (&sb[88], 2);
+  reserved_gdt_blocks = get_le (&sb[206], 2);
+
+  if (desc_size < 32 || desc_size > block_size ||
+      inode_size < 128 || inode_size > block_size ||
+      blocks_per_group == 0 || blocks <= first_data_block ||
+      blocks > size / block_size)
+    return -1;
+
+  ngroups = (blocks - first_data_block + blocks_per_group - 1) /
+    blocks_per_group;
+  gdb_count = (ngroups + block_size / desc_size - 1) / (block_size / desc_size);
+  itb_per_group = inodes_per_group / (block_size / inode_size);
+
+  /* The free counts in the superblock are not kept up to date, so
+   * like the kernel, add up the counts in the group descriptors.
+   */
+  if (gdb_count > SIZE_MAX / block_size)
+    return -1;
+  gdt = malloc (gdb_count * block_size);
+  if (gdt == NULL ||
+      read_at (fd, gdt, gdb_count * block_size,
+               offset + (first_data_block + 1) * block_size) == -1)
+    return -1;
+  for (group = 0; group < ngroups; ++group) {
+    const unsigned char *desc = &gdt[group * desc_size];
+
+    free_blocks += get_le (&desc[12], 2);
+    free_inodes += get_le (&desc[14], 2);
+    if (desc_size >= 64) {
+      free_blocks += get_le (&desc[44], 2) << 16;
+      free_inodes += get_le (&desc[46], 2) << 16;
+    }
+  }
+
+  /* Blocks used by the filesystem itself are not counted in the
+   * size.  Without bigalloc the kernel ignores s_overhead_clusters
+   * and calculates this in ext4_calculate_overhead.  Since Linux 5.18
+   * (see kernel_is_supported) that counts: the blocks before
+   * the first group, the superblock, group descriptor and reserved
+   * GDT blocks in groups with a backup superblock, the bitmaps and
+   * inode tables of every group, and the journal.
+   */
+  journal_blocks = ext4_journal_blocks (fd, offset, sb, block_size);
+  if (journal_blocks == 0)
+    return -1;
+  overhead = first_data_block + journal_blocks +
+    ngroups * (itb_per_group + 2);
+  for (group = 0; group < ngroups; ++group) {
+    if (ext4_bg_has_super (sb, group))
+      overhead += 1 + gdb_count + reserved_gdt_blocks;
+  }
+  if (overhead >= blocks)
+    return -1;
+
+  /* Blocks held back by ext4_calculate_resv_clusters. */
+  resv_blocks = 0;
+  if (incompat & EXT4_FEATURE_INCOMPAT_EXTENTS) {
+    resv_blocks = blocks / 50;
+    if (resv_blocks > 4096)
+      resv_blocks = 4096;
+  }
+
+  memset (stat, 0, sizeof *stat);
+  stat->bsize = block_size;
+  stat->frsize = block_size;
+  stat->blocks = blocks - overhead;
+  stat->bfree = free_blocks;
+  if (free_blocks >= r_blocks + resv_blocks)
+    stat->bavail = free_blocks - (r_blocks + resv_blocks);
+  stat->files = get_le (&sb[0], 4);
+  stat->ffree = free_inodes;
+  stat->favail = free_inodes;
+  stat->flag = 1;               /* ST_RDONLY */
+  stat->namemax = 255;
+  return 1;
+}
+
+/* blkid looks for a swap signature at the end of the first page, for
+ * each possible page size.
+ */
+static bool
+is_swap (int fd, uint64_t offset, uint64_t size)
+{
+  uint64_t page_size;
+  char sig[10];
+
+  for (page_size = 4096; page_size <= 65536; page_size *= 2) {
+    if (page_size > size ||
+        read_at (fd, sig, sizeof sig, offset + page_size - 10) == -1)
+      return false;
+    if (memcmp (sig, "SWAPSPACE2", 10) == 0 ||
+        memcmp (sig, "SWAP-SPACE", 10) == 0)
+      return true;
+  }
+  return false;
+}
+
+/* Examine the filesystem in one partition (or a whole disk).
+ * Returns -1 if it cannot be handled here.
+ */
+static int
+add_filesystem (int fd, uint64_t offset, uint64_t size, const char *dev,
+                struct fs_list *list)
+{
+  struct guestfs_statvfs stat;
+  struct fs *fs;
+
+  if (ext4_statvfs (fd, offset, size, &stat) == -1) {
+    /* virt-df doesn't show swap. */
+    if (is_swap (fd, offset, size))
+      return 0;
+    return -1;
+  }
+
+  /* A partition which also looks like swap is ambivalent to blkid. */
+  if (is_swap (fd, offset, size))
+    return -1;
+
+  list->fses = realloc (list->fses, (list->nr_fses + 1) * sizeof (struct fs));
+  if (list->fses == NULL)
+    return -1;
+  fs = &list->fses[list->nr_fses];
+  fs->dev = strdup (dev);
+  if (fs->dev == NULL)
+    return -1;
+  fs->stat = stat;
+  list->nr_fses++;
+  return 0;
+}
+
+/* GPT partition type of a BIOS boot partition, as stored on disk.
+ * It contains boot loader code and no filesystem, so list_filesystems
+ * reports it as "unknown".
+ */
+static const unsigned char bios_boot_guid[16] = "Hah!IdontNeedEFI";
+
+static int
+add_gpt_partitions (int fd, uint64_t disk_size, const char *disk,
+                    struct fs_list *list)
+{
+  unsigned char header[92];
+  unsigned char entry[128];
+  uint64_t entries_lba, nr_entries, entry_size, i;
+  static const unsigned char zero_guid[16];
+
+  if (read_at (fd, header, sizeof header, SECTOR_SIZE) == -1 ||
+      memcmp (header, "EFI PART", 8) != 0)
+    return -1;
+  entries_lba = get_le (&header[72], 8);
+  nr_entries = get_le (&header[80], 4);
+  entry_size = get_le (&header[84], 4);
+  if (entry_size < sizeof entry || nr_entries > MAX_PARTITIONS)
+    return -1;
+
+  for (i = 0; i < nr_entries; ++i) {
+    uint64_t first, last;
+    char dev[64];
+
+    if (read_at (fd, entry, sizeof entry,
+                 entries_lba * SECTOR_SIZE + i * entry_size) == -1)
+      return -1;
+    if (memcmp (entry, zero_guid, 16) == 0 ||
+        memcmp (entry, bios_boot_guid, 16) == 0)
+      continue;
+
+    first = get_le (&entry[32], 8);
+    last = get_le (&entry[40], 8);
+    if (first > last || (last + 1) * SECTOR_SIZE > disk_size)
+      return -1;
+
+    snprintf (dev, sizeof dev, "%s%" PRIu64, disk, i + 1);
+    if (add_filesystem (fd, first * SECTOR_SIZE,
+                        (last - first + 1) * SECTOR_SIZE, dev, list) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int
+add_disk (int fd, uint64_t disk_size, const char *disk, struct fs_list *list)
+{
+  unsigned char mbr[SECTOR_SIZE];
+  size_t i;
+
+  if (read_at (fd, mbr, sizeof mbr, 0) == -1)
+    return -1;
+
+  /* No partition table, so there may be a filesystem on the whole
+   * disk.
+   */
+  if (mbr[510] != 0x55 || mbr[511] != 0xaa)
+    return add_filesystem (fd, 0, disk_size, disk, list);
+
+  for (i = 0; i < 4; ++i) {
+    const unsigned char *part = &mbr[446 + i*16];
+
+    if (part[0] != 0 && part[0] != 0x80)
+      return -1;
+    if (part[4] == 0xee)
+      return add_gpt_partitions (fd, disk_size, disk, list);
+  }
+
+  for (i = 0; i < 4; ++i) {
+    const unsigned char *part = &mbr[446 + i*16];
+    const uint64_t start = get_le (&part[8], 4);
+    const uint64_t nr_sectors = get_le (&part[12], 4);
+    char dev[64];
+
+    switch (part[4]) {
+    case 0:
+      continue;
+    case 0x05: case 0x0f: case 0x85: /* Extended partitions. */
+      return -1;
+    }
+
+    if (nr_sectors == 0 || (start + nr_sectors) * SECTOR_SIZE > disk_size)
+      return -1;
+
+    snprintf (dev, sizeof dev, "%s%zu", disk, i + 1);
+    if (add_filesystem (fd, start * SECTOR_SIZE, nr_sectors * SECTOR_SIZE,
+                        dev, list) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+static void
+free_fs_list (struct fs_list *list)
+{
+  size_t i;
+
+  for (i = 0; i < list->nr_fses; ++i)
+    free (list->fses[i].dev);
+  free (list->fses);
+}
+
+/* True if a directory in the appliance path contains a fixed
+ * appliance, which boots its own kernel.
+ */
+static bool
+is_fixed_appliance (void)
+{
+  const char *path = guestfs_get_path (g);
+  const char *p;
+  size_t len;
+
+  if (path == NULL)
+    return true;
+
+  for (p = path; *p != '\0'; p += len + (p[len] == ':')) {
+    CLEANUP_FREE char *kernel = NULL;
+
+    len = strcspn (p, ":");
+    if (len == 0)
+      continue;
+    if (asprintf (&kernel, "%.*s/kernel", (int) len, p) == -1)
+      return true;
+    if (access (kernel, F_OK) == 0) {
+      if (verbose)
+        fprintf (stderr, "df_from_superblocks: fixed appliance in %.*s\n",
+                 (int) len, p);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* The overhead calculated in add_ext4 is what Linux 5.18 and later
+ * subtract from the size: earlier kernels did not count the reserved
+ * GDT blocks.  So the numbers can only be read directly if the kernel
+ * which the appliance boots is new enough.  That is not necessarily
+ * the running kernel: supermin picks the newest kernel in /boot which
+ * has modules installed, unless SUPERMIN_KERNEL says otherwise, and a
+ * fixed appliance has a kernel of its own.  Older kernels with the
+ * fix backported just take the slow path.
+ */
+static bool
+kernel_is_supported (void)
+{
+  glob_t gl;
+  size_t i;
+  unsigned major, minor, newest_major = 0, newest_minor = 0;
+
+  if (getenv ("SUPERMIN_KERNEL") != NULL) {
+    if (verbose)
+      fprintf (stderr, "df_from_superblocks: SUPERMIN_KERNEL is set\n");
+    return false;
+  }
+  if (is_fixed_appliance ())
+    return false;
+
+  if (glob ("/boot/vmlinu?-*", 0, NULL, &gl) == 0) {
+    for (i = 0; i < gl.gl_pathc; ++i) {
+      const char *version = strchr (gl.gl_pathv[i], '-') + 1;
+      CLEANUP_FREE char *modules = NULL;
+
+      if (sscanf (version, "%u.%u", &major, &minor) != 2 ||
+          asprintf (&modules, "/lib/modules/%s", version) == -1 ||
+          access (modules, F_OK) == -1)
+        continue;
+      if (major > newest_major ||
+          (major == newest_major && minor > newest_minor)) {
+        newest_major = major;
+        newest_minor = minor;
+      }
+    }
+    globfree (&gl);
+  }
+
+  if (newest_major == 0) {
+    if (verbose)
+      fprintf (stderr, "df_from_superblocks: no kernel found in /boot\n");
+    return false;
+  }
+  if (newest_major < 5 || (newest_major == 5 && newest_minor < 18)) {
+    if (verbose)
+      fprintf (stderr, "df_from_superblocks: kernel %u.%u is older than 5.18\n",
+               newest_major, newest_minor);
+    return false;
+  }
+  return true;
+}
+
+/* If the usage of every filesystem in these disk images can be read
+ * from the host, print it and return 0.  Otherwise print nothing and
+ * return -1, and the caller should use the appliance.
+ */
+int
+df_from_superblocks (struct drv *drvs, const char *name, FILE *fp)
+{
+  struct fs_list list = { .fses = NULL, .nr_fses = 0 };
+  CLEANUP_FREE struct drv **drives = NULL;
+  struct drv *drv;
+  size_t nr_drives = 0, i;
+  int r = -1;
+
+  for (drv = drvs; drv != NULL; drv = drv->next) {
+    if (drv->type != drv_a ||
+        (drv->a.blocksize != 0 && drv->a.blocksize != SECTOR_SIZE))
+      return -1;
+    nr_drives++;
+  }
+  if (nr_drives == 0 || nr_drives > 26 || !kernel_is_supported ())
+    return -1;
+
+  /* The drives are added to the appliance in reverse order of the
+   * list, so the last drive in the list is /dev/sda.
+   */
+  drives = malloc (nr_drives * sizeof (struct drv *));
+  if (drives == NULL)
+    return -1;
+  for (drv = drvs, i = nr_drives; drv != NULL; drv = drv->next)
+    drives[--i] = drv;
+
+  for (i = 0; i < nr_drives; ++i) {
+    char disk[16];
+    const char *format;
+    struct stat statbuf;
+    int fd, ret;
+
+    fd = open (drives[i]->a.filename, O_RDONLY|O_CLOEXEC);
+    if (fd == -1)
+      goto out;
+
+    /* Only raw images can be read directly.  Without --format, the
+     * appliance probes the format, so check the image has none of the
+     * signatures that probe_format knows (qcow2, vmdk, vdi, vhdx and
+     * others).  An image in a rarer format is read as raw, but then
+     * no partition table or ext4 superblock is found where expected
+     * and the appliance is used after all.
+     */
+    format = drives[i]->a.format;
+    if (format == NULL)
+      format = probe_format (fd);
+    if (fstat (fd, &statbuf) == -1 || !S_ISREG (statbuf.st_mode) ||
+        format == NULL || STRNEQ (format, "raw")) {
+      close (fd);
+      goto out;
+    }
+
+    snprintf (disk, sizeof disk, "/dev/sd%c", (int) ('a' + i));
+    ret = add_disk (fd, statbuf.st_size, disk, &list);
+    close (fd);
+    if (ret == -1)
+      goto out;
+  }
+
+  if (verbose)
+    fprintf (stderr, "df_from_superblocks: %s: read %zu filesystems\n",
+             name, list.nr_fses);
+
+  print_title ();
+  for (i = 0; i < list.nr_fses; ++i)
+    print_stat (fp, name, NULL, list.fses[i].dev, &list.fses[i].stat);
+  r = 0;
+
+ out:
+  free_fs_list (&list);
+  return r;
+}
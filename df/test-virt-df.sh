@@ -91,3 +91,51 @@ fi
 #    echo "$output"
 #    exit 1
 #fi
+
+# A raw image containing only an ext4 filesystem is read directly
+# from the host.  The numbers must be the same as the ones the
+# appliance returns, which we get by going through a qcow2 overlay.
+# This is the last test, so without qemu-img just stop here.
+if ! qemu-img --help >/dev/null 2>&1; then
+    echo "$0: host test skipped because qemu-img is not installed"
+    exit 0
+fi
+
+img=test-virt-df.img
+imgq=test-virt-df.qcow2
+rm -f $img $imgq test-virt-df.log
+guestfish -N $img=fs:ext4 exit
+qemu-img create -f qcow2 -b $img -F raw $imgq
+
+host=$($VG virt-df -v --csv --format=raw -a $img 2>test-virt-df.log |
+       cut -d, -f2-)
+appliance=$($VG virt-df --csv --format=qcow2 -a $imgq | cut -d, -f2-)
+if [ "$host" != "$appliance" ]; then
+    echo "$0: error: host and appliance output differ"
+    echo "host:"
+    echo "$host"
+    echo "appliance:"
+    echo "$appliance"
+    exit 1
+fi
+
+# Check that the first run really didn't use the appliance, unless
+# the appliance kernel is too old for it or cannot be known.
+if ! grep -E "df_from_superblocks: (kernel .* is older than|no kernel found|SUPERMIN_KERNEL is set|fixed appliance in)" test-virt-df.log &&
+   ! grep "df_from_superblocks: .*: read 1 filesystems" test-virt-df.log; then
+    echo "$0: error: raw image was not read from the host"
+    exit 1
+fi
+
+host=$($VG virt-df --csv -i --format=raw -a $img | cut -d, -f2-)
+appliance=$($VG virt-df --csv -i --format=qcow2 -a $imgq | cut -d, -f2-)
+if [ "$host" != "$appliance" ]; then
+    echo "$0: error: host and appliance inode output differ"
+    echo "host:"
+    echo "$host"
+    echo "appliance:"
+    echo "$appliance"
+    exit 1
+fi
+
+rm $img $imgq test-virt-df.log
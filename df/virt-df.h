@@ -30,6 +30,9 @@ extern int df_on_handle (guestfs_h *g, const char *name, const char *uuid, FILE
 extern int df_work (guestfs_h *g, size_t i, FILE *fp);
 #endif
 
+/* superblock.c */
+extern int df_from_superblocks (struct drv *drvs, const char *name, FILE *fp);
+
 /* output.c */
 extern void print_title (void);
 extern void print_stat (FILE *fp, const char *name, const char *uuid, const char *dev, const struct guestfs_statvfs *stat);
@@ -0,0 +1,216 @@
+/* Look up file checksums fetched in one call to the daemon
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* With --checksum, virt-diff and virt-ls fetch the checksums of all
+ * regular files in a single call to guestfs_checksums_out, instead of
+ * making one guestfs_checksum call per file.  The results are left in
+ * a temporary file on the host, and only the hash of each path and
+ * the offset of its line are held in memory (16 bytes per file).
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/types.h>
+
+#include "guestfs.h"
+#include "guestfs-utils.h"
+#include "options.h"
+
+#include "disk-id.h"
+#include "checksums.h"
+
+struct checksum_entry {
+  uint64_t hash;
+  off_t offset;
+};
+
+static int
+compare_entries (const void *e1v, const void *e2v)
+{
+  const struct checksum_entry *e1 = e1v;
+  const struct checksum_entry *e2 = e2v;
+
+  return e1->hash < e2->hash ? -1 : e1->hash > e2->hash;
+}
+
+/* Each line is "<checksum> [<size>] ./<path>".  Return a pointer to
+ * the path (after the '.') and end the checksum, or NULL if the line
+ * cannot be used.  Lines starting with a backslash are for file names
+ * which the checksum program had to escape.  These are skipped, so
+ * such files are checksummed individually by get_checksum.
+ */
+static char *
+parse_line (char *line, ssize_t len)
+{
+  char *p;
+
+  if (len > 0 && line[len-1] == '\n')
+    line[len-1] = '\0';
+  if (line[0] == '\\')
+    return NULL;
+  p = strstr (line, " ./");
+  if (p == NULL)
+    return NULL;
+  line[strcspn (line, " ")] = '\0';
+  return p + 2;
+}
+
+/* The hash of the full path, ie. the prefix followed by the path
+ * relative to it, which starts with '/'.
+ */
+static uint64_t
+hash_path (const char *prefix, const char *path)
+{
+  uint64_t h = HASH_INIT;
+
+  hash_update (&h, prefix, strlen (prefix));
+  hash_string (&h, path);
+  return h;
+}
+
+int
+read_checksums (struct checksums *c, guestfs_h *g,
+                const char *type, const char *dir)
+{
+  CLEANUP_FREE char *tmpdir = guestfs_get_tmpdir (g);
+  CLEANUP_FREE char *tmpfile = NULL;
+  CLEANUP_FREE char *line = NULL;
+  FILE *fp;
+  size_t len_prefix, allocated = 0, entries_allocated = 0;
+  off_t offset = 0;
+  ssize_t len;
+  int fd;
+
+  c->g = g;
+  c->type = type;
+  c->fp = NULL;
+  c->entries = NULL;
+  c->nr_entries = 0;
+
+  len_prefix = strlen (dir);
+  while (len_prefix > 0 && dir[len_prefix-1] == '/')
+    len_prefix--;
+  c->prefix = strndup (dir, len_prefix);
+  if (c->prefix == NULL)
+    error (EXIT_FAILURE, errno, "strndup");
+
+  if (asprintf (&tmpfile, "%s/checksumsXXXXXX", tmpdir) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp");
+  close (fd);
+
+  if (guestfs_checksums_out (g, type, dir, tmpfile) == -1) {
+    unlink (tmpfile);
+    return -1;
+  }
+
+  fp = fopen (tmpfile, "r");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "fopen: %s", tmpfile);
+  unlink (tmpfile);
+
+  while ((len = getline (&line, &allocated, fp)) != -1) {
+    const char *path = parse_line (line, len);
+
+    if (path != NULL) {
+      if (c->nr_entries >= entries_allocated) {
+        entries_allocated = entries_allocated == 0 ? 1024 : entries_allocated * 2;
+        c->entries = realloc (c->entries,
+                              entries_allocated * sizeof (struct checksum_entry));
+        if (c->entries == NULL)
+          error (EXIT_FAILURE, errno, "realloc");
+      }
+      c->entries[c->nr_entries].hash = hash_path (c->prefix, path);
+      c->entries[c->nr_entries].offset = offset;
+      c->nr_entries++;
+    }
+    offset += len;
+  }
+
+  qsort (c->entries, c->nr_entries, sizeof (struct checksum_entry),
+         compare_entries);
+  c->fp = fp;
+
+  if (verbose)
+    fprintf (stderr, "read %zu checksums from %s\n", c->nr_entries, dir);
+
+  return 0;
+}
+
+char *
+get_checksum (struct checksums *c, const char *path)
+{
+  const struct checksum_entry key = { .hash = hash_path ("", path) };
+  const struct checksum_entry *e, *end = c->entries + c->nr_entries;
+  const size_t len_prefix = c->prefix ? strlen (c->prefix) : 0;
+  CLEANUP_FREE char *line = NULL;
+  size_t allocated = 0;
+  ssize_t len;
+  char *ret;
+
+  if (c->nr_entries == 0)
+    return guestfs_checksum (c->g, c->type, path);
+  e = bsearch (&key, c->entries, c->nr_entries,
+               sizeof (struct checksum_entry), compare_entries);
+  if (e == NULL || strncmp (path, c->prefix, len_prefix) != 0)
+    return guestfs_checksum (c->g, c->type, path);
+
+  /* Different paths may have the same hash, so check every line with
+   * this hash.
+   */
+  while (e > c->entries && e[-1].hash == key.hash)
+    e--;
+  for (; e < end && e->hash == key.hash; ++e) {
+    const char *p;
+
+    if (fseeko (c->fp, e->offset, SEEK_SET) == -1 ||
+        (len = getline (&line, &allocated, c->fp)) == -1)
+      error (EXIT_FAILURE, errno, "checksums file");
+    p = parse_line (line, len);
+    if (p != NULL && STREQ (p, path + len_prefix)) {
+      ret = strdup (line);
+      if (ret == NULL)
+        error (EXIT_FAILURE, errno, "strdup");
+      return ret;
+    }
+  }
+
+  return guestfs_checksum (c->g, c->type, path);
+}
+
+void
+free_checksums (struct checksums *c)
+{
+  if (c->fp)
+    fclose (c->fp);
+  free (c->entries);
+  free (c->prefix);
+  c->fp = NULL;
+  c->entries = NULL;
+  c->nr_entries = 0;
+  c->prefix = NULL;
+}
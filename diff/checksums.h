@@ -0,0 +1,52 @@
+/* Look up file checksums fetched in one call to the daemon
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GUESTFS_CHECKSUMS_H
+#define GUESTFS_CHECKSUMS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "guestfs.h"
+
+struct checksums {
+  guestfs_h *g;
+  const char *type;             /* eg. "md5" */
+  char *prefix;                 /* Directory, without trailing '/'. */
+  FILE *fp;                     /* Output of guestfs_checksums_out. */
+  struct checksum_entry *entries; /* Sorted by hash. */
+  size_t nr_entries;
+};
+
+/* Fetch the checksums of all regular files under 'dir' into a
+ * temporary file on the host.  Returns -1 if the daemon call failed,
+ * in which case get_checksum still works but checksums each file
+ * separately.
+ */
+extern int read_checksums (struct checksums *c, guestfs_h *g,
+                           const char *type, const char *dir);
+
+/* Return the checksum of 'path', which must be freed by the caller,
+ * or NULL on error.
+ */
+extern char *get_checksum (struct checksums *c, const char *path);
+
+extern void free_checksums (struct checksums *c);
+
+#endif /* GUESTFS_CHECKSUMS_H */
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
@@ -31,6 +32,7 @@
 #include <assert.h>
 #include <time.h>
 #include <libintl.h>
+#include <pthread.h>
 #include <sys/wait.h>
 
 #if MAJOR_IN_MKDEV
@@ -52,11 +54,21 @@
 #include "guestfs-utils.h"
 #include "visit.h"
 
-/* Internal tree structure built for each guest. */
-struct tree;
-static struct tree *visit_guest (guestfs_h *g);
-static int diff_guests (struct tree *t1, struct tree *t2);
-static void free_tree (struct tree *);
+#include "checksums.h"
+#include "disk-id.h"
+#include "virt-diff.h"
+
+
+/* Each guest is launched and inspected in its own thread. */
+struct guest_thread {
+  guestfs_h *g;
+  struct key_store *ks;
+  bool network;
+  struct checksums csums;       /* With --checksum. */
+};
+static void *start_guest (void *gtv);
+static bool is_unmodified_snapshot (struct drv *base, struct drv *overlay);
+static int diff_guests (struct guest_thread *gt1, struct guest_thread *gt2);
 
 /* Libguestfs handles for two source guests. */
 guestfs_h *g, *g2;
@@ -75,6 +87,7 @@ static int csv = 0;
 static int dir_links = 0;
 static int dir_times = 0;
 static int human = 0;
+static int json = 0;
 static int enable_extra_stats = 0;
 static int enable_times = 0;
 static int enable_uids = 0;
@@ -129,6 +142,7 @@ usage (int status)
               "  --format[=raw|..]    Force disk format for -a or -A option\n"
               "  --help               Display brief help\n"
               "  -h|--human-readable  Human-readable sizes in output\n"
+              "  --json               JSON Lines output\n"
               "  --key selector       Specify a LUKS key\n"
               "  --keys-from-stdin    Read passphrases from stdin\n"
               "  --times              Display file times\n"
@@ -182,6 +196,7 @@ main (int argc, char *argv[])
     { "format", 2, 0, 0 },
     { "help", 0, 0, HELP_OPTION },
     { "human-readable", 0, 0, 'h' },
+    { "json", 0, 0, 0 },
     { "long-options", 0, 0, 0 },
     { "key", 1, 0, 0 },
     { "keys-from-stdin", 0, 0, 0 },
@@ -207,9 +222,12 @@ main (int argc, char *argv[])
   bool blocksize_consumed = true;
   int c;
   int option_index;
-  struct tree *tree1, *tree2;
   struct key_store *ks = NULL;
   bool network;
+  struct guest_thread gt[2];
+  pthread_t thread[2];
+  size_t i;
+  int err;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -245,6 +263,8 @@ main (int argc, char *argv[])
         atime = 1;
       } else if (STREQ (long_options[option_index].name, "csv")) {
         csv = 1;
+      } else if (STREQ (long_options[option_index].name, "json")) {
+        json = 1;
       } else if (STREQ (long_options[option_index].name, "checksum") ||
                  STREQ (long_options[option_index].name, "checksums")) {
         if (!optarg || STREQ (optarg, ""))
@@ -355,6 +375,8 @@ main (int argc, char *argv[])
    */
   if (human && csv)
     error (EXIT_FAILURE, 0, _("you cannot use -h and --csv options together."));
+  if (json && csv)
+    error (EXIT_FAILURE, 0, _("you cannot use --json and --csv options together."));
 
   if (optind != argc) {
     fprintf (stderr, _("%s: error: extra argument ‘%s’ on command line.\n"
@@ -374,44 +396,52 @@ main (int argc, char *argv[])
   CHECK_OPTION_format_consumed;
   CHECK_OPTION_blocksize_consumed;
 
+  /* Comparing a snapshot with the disk it was taken from is common.
+   * If nothing has been written to the snapshot yet then there can't
+   * be any differences, so don't launch the appliances at all.
+   */
+  if (is_unmodified_snapshot (drvs, drvs2) ||
+      is_unmodified_snapshot (drvs2, drvs)) {
+    if (verbose)
+      fprintf (stderr, "%s: snapshot has not been modified\n",
+               getprogname ());
+    free_drives (drvs);
+    free_drives (drvs2);
+    free_key_store (ks);
+    guestfs_close (g);
+    guestfs_close (g2);
+    exit (EXIT_SUCCESS);
+  }
+
   unsigned errors = 0;
 
-  /* Mount up first guest. */
   add_drives (drvs);
-
-  network = key_store_requires_network (ks);
-  if (guestfs_set_network (g, network) == -1)
-    exit (EXIT_FAILURE);
-
-  if (guestfs_launch (g) == -1)
-    exit (EXIT_FAILURE);
-
-  inspect_mount ();
-
-  if ((tree1 = visit_guest (g)) == NULL)
-    errors++;
-
-  /* Mount up second guest. */
   add_drives_handle (g2, drvs2, 0);
 
-  if (guestfs_set_network (g2, network) == -1)
-    exit (EXIT_FAILURE);
-
-  if (guestfs_launch (g2) == -1)
-    exit (EXIT_FAILURE);
+  network = key_store_requires_network (ks);
 
-  inspect_mount_handle (g2, ks);
+  /* Launch and inspect both guests at the same time. */
+  gt[0].g = g;
+  gt[1].g = g2;
+  for (i = 0; i < 2; ++i) {
+    gt[i].ks = ks;
+    gt[i].network = network;
+    memset (&gt[i].csums, 0, sizeof gt[i].csums);
+    err = pthread_create (&thread[i], NULL, start_guest, &gt[i]);
+    if (err != 0)
+      error (EXIT_FAILURE, err, "pthread_create");
+  }
+  for (i = 0; i < 2; ++i) {
+    err = pthread_join (thread[i], NULL);
+    if (err != 0)
+      error (EXIT_FAILURE, err, "pthread_join");
+  }
 
-  if ((tree2 = visit_guest (g2)) == NULL)
+  if (diff_guests (&gt[0], &gt[1]) == -1)
     errors++;
 
-  if (errors == 0) {
-    if (diff_guests (tree1, tree2) == -1)
-      errors++;
-  }
-
-  free_tree (tree1);
-  free_tree (tree2);
+  free_checksums (&gt[0].csums);
+  free_checksums (&gt[1].csums);
 
   free_drives (drvs);
   free_drives (drvs2);
@@ -424,121 +454,129 @@ main (int argc, char *argv[])
   exit (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
-struct tree {
-  /* We store the handle here in case we need to go and dig into
-   * the disk to get file content.
+/* Is 'overlay' a single qcow2 disk image backed by the single disk
+ * image 'base', which has never been written to?
+ */
+static bool
+is_unmodified_snapshot (struct drv *base, struct drv *overlay)
+{
+  if (base->next != NULL || overlay->next != NULL ||
+      base->type != drv_a || overlay->type != drv_a)
+    return false;
+
+  if (overlay->a.format != NULL && STRNEQ (overlay->a.format, "qcow2"))
+    return false;
+
+  return is_unmodified_overlay (overlay->a.filename,
+                                base->a.filename, base->a.format);
+}
+
+/* Inspection may have to prompt for LUKS passphrases, so the two
+ * threads must not do it at the same time.
+ */
+static pthread_mutex_t inspect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+start_guest (void *gtv)
+{
+  struct guest_thread *gt = gtv;
+
+  if (guestfs_set_network (gt->g, gt->network) == -1 ||
+      guestfs_launch (gt->g) == -1)
+    exit (EXIT_FAILURE);
+
+  pthread_mutex_lock (&inspect_lock);
+  inspect_mount_handle (gt->g, gt->ks);
+  pthread_mutex_unlock (&inspect_lock);
+
+  /* If the batch call fails (eg. because some file could not be
+   * read), fall back to checksumming each file separately.
    */
-  guestfs_h *g;
+  if (checksum && read_checksums (&gt->csums, gt->g, checksum, "/") == -1 &&
+      verbose)
+    fprintf (stderr, "%s: checksumming files individually\n", getprogname ());
 
-  /* List of files found, sorted by path. */
-  struct file *files;
-  size_t nr_files, allocated;
-};
+  return NULL;
+}
 
 struct file {
-  char *path;
+  const char *path;             /* Points into dir->paths. */
   struct guestfs_statns *stat;
   struct guestfs_xattr_list *xattrs;
   char *csum;                  /* Checksum. If NULL, use file times and size. */
 };
 
-static void
-free_tree (struct tree *t)
-{
-  size_t i;
+/* The entries of a single directory in one guest.  Only the
+ * directories along the path currently being compared are held in
+ * memory, so memory use depends on the depth of the tree and not on
+ * the number of files in the guest (except for the 16 bytes per file
+ * in gt->csums with --checksum).
+ */
+struct dir {
+  struct guest_thread *gt;      /* NULL if not in this guest. */
 
-  if (t == NULL)
-    return;
+  /* We store the handle here in case we need to go and dig into
+   * the disk to get file content.  If NULL, the directory does not
+   * exist in this guest.
+   */
+  guestfs_h *g;
 
-  for (i = 0; i < t->nr_files; ++i) {
-    free (t->files[i].path);
-    guestfs_free_statns (t->files[i].stat);
-    guestfs_free_xattr_list (t->files[i].xattrs);
-    free (t->files[i].csum);
-  }
+  /* Directory path, or NULL for the pseudo-directory containing
+   * only the root directory.
+   */
+  const char *path;
 
-  free (t->files);
+  /* List of files found, sorted by name. */
+  struct file *files;
+  size_t nr_files;
 
-  free (t);
-}
+  /* Storage which the files point into.  The paths of all the
+   * entries are stored one after another in a single block.
+   */
+  char *paths;
+  char **names;
+  struct guestfs_statns_list *stats;
+  struct guestfs_xattr_list *xattrs;
+  struct guestfs_xattr_list *file_xattrs;
+  struct guestfs_statns *root_stat;
 
-static int visit_entry (const char *dir, const char *name, const struct guestfs_statns *stat, const struct guestfs_xattr_list *xattrs, void *vt);
+  int r;                        /* Return value of read_dir. */
+};
 
-static struct tree *
-visit_guest (guestfs_h *g)
+static void
+free_dir (struct dir *d)
 {
-  struct tree *t = malloc (sizeof *t);
-
-  if (t == NULL) {
-    perror ("malloc");
-    return NULL;
-  }
-
-  t->g = g;
-  t->files = NULL;
-  t->nr_files = t->allocated = 0;
-
-  if (visit (g, "/", visit_entry, t) == -1) {
-    free_tree (t);
-    return NULL;
-  }
+  size_t i;
 
-  if (verbose)
-    fprintf (stderr, "read %zu entries from guest\n", t->nr_files);
+  for (i = 0; i < d->nr_files; ++i)
+    free (d->files[i].csum);
+  free (d->files);
 
-  return t;
+  free (d->paths);
+  guestfs_int_free_string_list (d->names);
+  guestfs_free_statns_list (d->stats);
+  guestfs_free_xattr_list (d->xattrs);
+  free (d->file_xattrs);
+  guestfs_free_statns (d->root_stat);
 }
 
-/* In visit_entry, GCC 14 falsely reports:
- *
- * diff.c: In function ‘visit_entry’:
- * diff.c:565:16: error: pointer ‘old_files_95’ may be used after ‘realloc’ [-Werror=use-after-free]
- *   565 |       t->files = old_files;
- *       |       ~~~~~~~~~^~~~~~~~~~~
- * diff.c:562:16: note: call to ‘realloc’ here
- *   562 |     t->files = realloc (old_files, t->allocated * sizeof (struct file));
- *       |                ^~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
- */
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wuse-after-free"
-
-/* Visit each directory/file/etc entry in the tree.  This just stores
- * the data in the tree.  Note we don't store file content, but we
- * keep the guestfs handle open so we can pull that out later if we
- * need to.
+/* Fill in one entry.  Note we don't store file content, but we keep
+ * the guestfs handle so we can pull that out later if we need to.
  */
 static int
-visit_entry (const char *dir, const char *name,
-             const struct guestfs_statns *stat_orig,
-             const struct guestfs_xattr_list *xattrs_orig,
-             void *vt)
+add_file (struct dir *d, size_t i, const char *path,
+          struct guestfs_statns *stat, struct guestfs_xattr_list *xattrs)
 {
-  struct tree *t = vt;
-  char *path = NULL, *csum = NULL;
-  struct guestfs_statns *stat = NULL;
-  struct guestfs_xattr_list *xattrs = NULL;
-  size_t i;
+  struct file *file = &d->files[i];
 
-  path = guestfs_int_full_path (dir, name);
-  if (!path) {
-    perror ("guestfs_int_full_path");
-    goto error;
-  }
-
-  /* Copy the stats and xattrs because the visit function will
-   * free them after we return.
-   */
-  stat = guestfs_copy_statns (stat_orig);
-  if (stat == NULL)
-    goto error;
-  xattrs = guestfs_copy_xattr_list (xattrs_orig);
-  if (xattrs == NULL)
-    goto error;
+  file->path = path;
+  file->stat = stat;
+  file->xattrs = xattrs;
 
   if (checksum && guestfs_int_is_reg (stat->st_mode)) {
-    csum = guestfs_checksum (t->g, checksum, path);
-    if (!csum)
-      goto error;
+    file->csum = get_checksum (&d->gt->csums, file->path);
+    if (!file->csum)
+      return -1;
   }
 
   /* If --atime option was NOT passed, flatten the atime field. */
@@ -558,45 +596,172 @@ visit_entry (const char *dir, const char *name,
     stat->st_atime_sec = stat->st_mtime_sec = stat->st_ctime_sec =
       stat->st_atime_nsec = stat->st_mtime_nsec = stat->st_ctime_nsec = 0;
 
-  /* Add the pathname and stats to the list. */
-  i = t->nr_files++;
-  if (i >= t->allocated) {
-    struct file *old_files = t->files;
-    const size_t old_allocated = t->allocated;
+  return 0;
+}
 
-    /* Number of entries in an F15 guest was 111524, and in a
-     * Windows guest was 10709.
-     */
-    if (old_allocated == 0)
-      t->allocated = 1024;
-    else
-      t->allocated = old_allocated * 2;
-
-    t->files = realloc (old_files, t->allocated * sizeof (struct file));
-    if (t->files == NULL) {
-      perror ("realloc");
-      t->files = old_files;
-      t->allocated = old_allocated;
-      goto error;
+/* Read the entries of a directory, with their stats and extended
+ * attributes, in a few calls to the daemon.
+ */
+static int
+read_dir (struct dir *d)
+{
+  size_t i, xattrp, size;
+  const char *dir, *file_path;
+  char *path;
+
+  if (d->g == NULL)
+    return 0;
+
+  if (d->path == NULL) {
+    d->root_stat = guestfs_lstatns (d->g, "/");
+    if (d->root_stat == NULL)
+      return -1;
+    d->xattrs = guestfs_lgetxattrs (d->g, "/");
+    if (d->xattrs == NULL)
+      return -1;
+    d->paths = strdup ("/");
+    d->files = calloc (1, sizeof (struct file));
+    if (d->paths == NULL || d->files == NULL) {
+      perror ("malloc");
+      return -1;
     }
+    d->nr_files = 1;
+    return add_file (d, 0, d->paths, d->root_stat, d->xattrs);
   }
 
-  t->files[i].path = path;
-  t->files[i].stat = stat;
-  t->files[i].xattrs = xattrs;
-  t->files[i].csum = csum;
+  d->names = guestfs_ls (d->g, d->path);
+  if (d->names == NULL)
+    return -1;
+  if (d->names[0] == NULL)
+    return 0;
+  d->stats = guestfs_lstatnslist (d->g, d->path, d->names);
+  if (d->stats == NULL)
+    return -1;
+  if (d->stats->len != guestfs_int_count_strings (d->names)) {
+    fprintf (stderr, _("%s: error: unexpected number of stats for %s\n"),
+             getprogname (), d->path);
+    return -1;
+  }
+  d->xattrs = guestfs_lxattrlist (d->g, d->path, d->names);
+  if (d->xattrs == NULL)
+    return -1;
+
+  dir = STREQ (d->path, "/") ? "" : d->path;
+  size = 0;
+  for (i = 0; d->names[i] != NULL; ++i)
+    size += strlen (dir) + strlen (d->names[i]) + 2;
+
+  d->paths = malloc (size);
+  d->files = calloc (d->stats->len, sizeof (struct file));
+  d->file_xattrs = calloc (d->stats->len, sizeof (struct guestfs_xattr_list));
+  if (d->paths == NULL || d->files == NULL || d->file_xattrs == NULL) {
+    perror ("malloc");
+    return -1;
+  }
+  path = d->paths;
+
+  /* lxattrlist returns the attributes of all the files in one list.
+   * Each file's attributes are preceded by an entry with an empty
+   * name whose value is the number of attributes that follow.
+   */
+  for (i = 0, xattrp = 0; d->names[i] != NULL; ++i, ++xattrp) {
+    char count[32];
+    size_t len, nr_xattrs;
+
+    if (xattrp >= d->xattrs->len ||
+        STRNEQ (d->xattrs->val[xattrp].attrname, ""))
+      goto bad_xattrs;
+    len = d->xattrs->val[xattrp].attrval_len;
+    if (len == 0 || len >= sizeof count)
+      goto bad_xattrs;
+    memcpy (count, d->xattrs->val[xattrp].attrval, len);
+    count[len] = '\0';
+    if (sscanf (count, "%zu", &nr_xattrs) != 1 ||
+        nr_xattrs >= d->xattrs->len - xattrp)
+      goto bad_xattrs;
+
+    d->file_xattrs[i].len = nr_xattrs;
+    d->file_xattrs[i].val = &d->xattrs->val[xattrp+1];
+    xattrp += nr_xattrs;
+
+    file_path = path;
+    path = stpcpy (stpcpy (stpcpy (path, dir), "/"), d->names[i]) + 1;
+
+    d->nr_files++;
+    if (add_file (d, i, file_path,
+                  &d->stats->val[i], &d->file_xattrs[i]) == -1)
+      return -1;
+  }
 
   return 0;
 
- error:
-  free (path);
-  free (csum);
-  guestfs_free_statns (stat);
-  guestfs_free_xattr_list (xattrs);
+ bad_xattrs:
+  fprintf (stderr, _("%s: error: cannot parse extended attributes in %s\n"),
+           getprogname (), d->path);
   return -1;
 }
 
-#pragma GCC diagnostic pop
+static void *
+read_dir_thread (void *dv)
+{
+  struct dir *d = dv;
+
+  d->r = read_dir (d);
+  return NULL;
+}
+
+/* Read the same directory from both guests.  The handles are
+ * independent, so the second guest is read in another thread while
+ * this thread reads the first.
+ */
+static int
+read_dirs (struct dir *d1, struct dir *d2)
+{
+  pthread_t thread;
+  int err;
+
+  if (d1->g == NULL || d2->g == NULL)
+    return read_dir (d1) == -1 || read_dir (d2) == -1 ? -1 : 0;
+
+  err = pthread_create (&thread, NULL, read_dir_thread, d2);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_create");
+  d1->r = read_dir (d1);
+  err = pthread_join (thread, NULL);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_join");
+
+  return d1->r == -1 || d2->r == -1 ? -1 : 0;
+}
+
+/* Step through the entries of two directories in name order.  On
+ * each step, *f1 and *f2 are set to the entries with the next name,
+ * or to NULL if that name does not appear in one of the directories.
+ */
+static bool
+next_entry (struct dir *d1, size_t *i1, struct file **f1,
+            struct dir *d2, size_t *i2, struct file **f2)
+{
+  int comp;
+
+  *f1 = *i1 < d1->nr_files ? &d1->files[*i1] : NULL;
+  *f2 = *i2 < d2->nr_files ? &d2->files[*i2] : NULL;
+
+  if (*f1 && *f2) {
+    comp = strcmp ((*f1)->path, (*f2)->path);
+    if (comp < 0)
+      *f2 = NULL;
+    else if (comp > 0)
+      *f1 = NULL;
+  }
+
+  if (*f1)
+    (*i1)++;
+  if (*f2)
+    (*i2)++;
+
+  return *f1 || *f2;
+}
 
 static void deleted (guestfs_h *, struct file *);
 static void added (guestfs_h *, struct file *);
@@ -604,62 +769,83 @@ static int compare_stats (struct file *, struct file *);
 static void changed (guestfs_h *, struct file *, guestfs_h *, struct file *, int st, int cst);
 static void diff (struct file *, guestfs_h *, struct file *, guestfs_h *);
 static void output_file (guestfs_h *, struct file *);
+static void json_change (const char *change, guestfs_h *g1, struct file *file1, guestfs_h *g2, struct file *file2);
+static void json_changed_fields (struct file *file1, struct file *file2);
 
+/* Compare a directory in the two guests, then recurse into its
+ * subdirectories.  If the directory exists in only one guest ('g1'
+ * or 'g2' is NULL) then everything under it was added or deleted.
+ */
 static int
-diff_guests (struct tree *t1, struct tree *t2)
+diff_dirs (struct guest_thread *gt1, struct guest_thread *gt2,
+           const char *path)
 {
-  struct file *i1 = &t1->files[0];
-  struct file *i2 = &t2->files[0];
-  struct file *end1 = &t1->files[t1->nr_files];
-  struct file *end2 = &t2->files[t2->nr_files];
-
-  while (i1 < end1 || i2 < end2) {
-    if (i1 < end1 && i2 < end2) {
-      const int comp = strcmp (i1->path, i2->path);
-
-      /* i1->path < i2->path.  i1 catches up with i2 (files deleted) */
-      if (comp < 0) {
-        deleted (t1->g, i1);
-        i1++;
-      }
-      /* i1->path > i2->path.  i2 catches up with i1 (files added) */
-      else if (comp > 0) {
-        added (t2->g, i2);
-        i2++;
-      }
-      /* Otherwise i1->path == i2->path, compare in detail. */
-      else {
-        const int st = compare_stats (i1, i2);
-        if (st != 0)
-          changed (t1->g, i1, t2->g, i2, st, 0);
-        else if (i1->csum && i2->csum) {
-          const int cst = strcmp (i1->csum, i2->csum);
-          changed (t1->g, i1, t2->g, i2, 0, cst);
-        }
-        i1++;
-        i2++;
+  guestfs_h *g1 = gt1 ? gt1->g : NULL;
+  guestfs_h *g2 = gt2 ? gt2->g : NULL;
+  struct dir d1 = { .gt = gt1, .g = g1, .path = path };
+  struct dir d2 = { .gt = gt2, .g = g2, .path = path };
+  struct file *f1, *f2;
+  size_t i1, i2;
+  int r = -1;
+
+  if (read_dirs (&d1, &d2) == -1)
+    goto out;
+
+  i1 = i2 = 0;
+  while (next_entry (&d1, &i1, &f1, &d2, &i2, &f2)) {
+    if (f1 && f2) {
+      const int st = compare_stats (f1, f2);
+      if (st != 0)
+        changed (g1, f1, g2, f2, st, 0);
+      else if (f1->csum && f2->csum) {
+        const int cst = strcmp (f1->csum, f2->csum);
+        changed (g1, f1, g2, f2, 0, cst);
       }
     }
-    /* Reached end of i2 list (files deleted). */
-    else if (i1 < end1) {
-      deleted (t1->g, i1);
-      i1++;
-    }
-    /* Reached end of i1 list (files added). */
-    else {
-      added (t2->g, i2);
-      i2++;
-    }
+    else if (f1)
+      deleted (g1, f1);
+    else
+      added (g2, f2);
+  }
+
+  i1 = i2 = 0;
+  while (next_entry (&d1, &i1, &f1, &d2, &i2, &f2)) {
+    const bool is_dir1 = f1 && guestfs_int_is_dir (f1->stat->st_mode);
+    const bool is_dir2 = f2 && guestfs_int_is_dir (f2->stat->st_mode);
+
+    if ((is_dir1 || is_dir2) &&
+        diff_dirs (is_dir1 ? gt1 : NULL, is_dir2 ? gt2 : NULL,
+                   is_dir1 ? f1->path : f2->path) == -1)
+      goto out;
   }
 
+  r = 0;
+ out:
+  free_dir (&d1);
+  free_dir (&d2);
+  return r;
+}
+
+static int
+diff_guests (struct guest_thread *gt1, struct guest_thread *gt2)
+{
+  int r;
+
+  r = diff_dirs (gt1, gt2, NULL);
+
   output_flush ();
 
-  return 0;
+  return r;
 }
 
 static void
 deleted (guestfs_h *g, struct file *file)
 {
+  if (json) {
+    json_change ("deleted", g, file, NULL, NULL);
+    return;
+  }
+
   output_start_line ();
   output_string ("-");
   output_file (g, file);
@@ -669,6 +855,11 @@ deleted (guestfs_h *g, struct file *file)
 static void
 added (guestfs_h *g, struct file *file)
 {
+  if (json) {
+    json_change ("added", NULL, NULL, g, file);
+    return;
+  }
+
   output_start_line ();
   output_string ("+");
   output_file (g, file);
@@ -703,6 +894,11 @@ changed (guestfs_h *g1, struct file *file1,
        (file1->stat->st_mtime_sec != file2->stat->st_mtime_sec ||
         file1->stat->st_ctime_sec != file2->stat->st_ctime_sec ||
         file1->stat->st_size != file2->stat->st_size))) {
+    if (json) {
+      json_change ("content", g1, file1, g2, file2);
+      return;
+    }
+
     output_start_line ();
     output_string ("=");
     output_file (g1, file1);
@@ -717,6 +913,11 @@ changed (guestfs_h *g1, struct file *file1,
 
   /* Did just stats change? */
   else if (st != 0) {
+    if (json) {
+      json_change ("metadata", g1, file1, g2, file2);
+      return;
+    }
+
     output_start_line ();
     output_string ("-");
     output_file (g1, file1);
@@ -764,9 +965,53 @@ changed (guestfs_h *g1, struct file *file1,
   }
 }
 
+/* Files larger than this are compared by the external diff program,
+ * since print_unified_diff needs the whole of both files in memory.
+ */
+#define MAX_DIFF_SIZE (8 * 1024 * 1024)
+
+static void diff_external (struct file *, guestfs_h *, struct file *, guestfs_h *);
+
 /* Run a diff on two files. */
 static void
 diff (struct file *file1, guestfs_h *g1, struct file *file2, guestfs_h *g2)
+{
+  CLEANUP_FREE char *content1 = NULL, *content2 = NULL;
+  size_t len1, len2;
+
+  assert (guestfs_int_is_reg (file1->stat->st_mode));
+  assert (guestfs_int_is_reg (file2->stat->st_mode));
+
+  if (file1->stat->st_size > MAX_DIFF_SIZE ||
+      file2->stat->st_size > MAX_DIFF_SIZE) {
+    diff_external (file1, g1, file2, g2);
+    return;
+  }
+
+  content1 = guestfs_read_file (g1, file1->path, &len1);
+  if (content1 == NULL)
+    return;
+  content2 = guestfs_read_file (g2, file2->path, &len2);
+  if (content2 == NULL)
+    return;
+
+  /* Like diff, don't show the changes in binary files. */
+  if (memchr (content1, '\0', len1) != NULL ||
+      memchr (content2, '\0', len2) != NULL) {
+    if (printf ("@@ %s @@\n", _("Binary files differ")) < 0)
+      error (EXIT_FAILURE, errno, "printf");
+  }
+  else
+    print_unified_diff (content1, len1, content2, len2);
+
+  if (printf ("@@ %s @@\n", _("End of diff")) < 0)
+    error (EXIT_FAILURE, errno, "printf");
+}
+
+/* Run the external diff program on two files. */
+static void
+diff_external (struct file *file1, guestfs_h *g1,
+               struct file *file2, guestfs_h *g2)
 {
   CLEANUP_FREE char *tmpdir = guestfs_get_tmpdir (g1);
   CLEANUP_FREE char *tmpd, *tmpda = NULL, *tmpdb = NULL, *cmd = NULL;
@@ -811,31 +1056,34 @@ diff (struct file *file1, guestfs_h *g1, struct file *file2, guestfs_h *g2)
   rmdir (tmpd);
 }
 
+static const char *
+file_type (int64_t mode)
+{
+  if (guestfs_int_is_reg (mode))
+    return "-";
+  else if (guestfs_int_is_dir (mode))
+    return "d";
+  else if (guestfs_int_is_chr (mode))
+    return "c";
+  else if (guestfs_int_is_blk (mode))
+    return "b";
+  else if (guestfs_int_is_fifo (mode))
+    return "p";
+  else if (guestfs_int_is_lnk (mode))
+    return "l";
+  else if (guestfs_int_is_sock (mode))
+    return "s";
+  else
+    return "u";
+}
+
 static void
 output_file (guestfs_h *g, struct file *file)
 {
-  const char *filetype;
   size_t i;
   CLEANUP_FREE char *link = NULL;
 
-  if (guestfs_int_is_reg (file->stat->st_mode))
-    filetype = "-";
-  else if (guestfs_int_is_dir (file->stat->st_mode))
-    filetype = "d";
-  else if (guestfs_int_is_chr (file->stat->st_mode))
-    filetype = "c";
-  else if (guestfs_int_is_blk (file->stat->st_mode))
-    filetype = "b";
-  else if (guestfs_int_is_fifo (file->stat->st_mode))
-    filetype = "p";
-  else if (guestfs_int_is_lnk (file->stat->st_mode))
-    filetype = "l";
-  else if (guestfs_int_is_sock (file->stat->st_mode))
-    filetype = "s";
-  else
-    filetype = "u";
-
-  output_string (filetype);
+  output_string (file_type (file->stat->st_mode));
   output_int64_perms (file->stat->st_mode & 07777);
 
   output_int64_size (file->stat->st_size);
@@ -882,6 +1130,216 @@ output_file (guestfs_h *g, struct file *file)
   }
 }
 
+/* JSON Lines output (--json).  Each change is printed as a single
+ * JSON object on one line.  Numbers are always printed unformatted,
+ * and the content of changed files is not shown.
+ */
+static void json_printf (const char *fs, ...)
+  __attribute__((format (printf,1,2)));
+
+static void
+json_printf (const char *fs, ...)
+{
+  va_list args;
+  int r;
+
+  va_start (args, fs);
+  r = vprintf (fs, args);
+  va_end (args);
+  if (r < 0)
+    error (EXIT_FAILURE, errno, "printf");
+}
+
+/* Return the length of the valid UTF-8 sequence at the start of 's',
+ * or 0 if it is not valid.
+ */
+static size_t
+utf8_sequence_length (const unsigned char *s, size_t len)
+{
+  size_t n, i;
+  uint32_t c;
+
+  if (s[0] < 0x80)
+    return 1;
+  else if (s[0] >= 0xc2 && s[0] <= 0xdf)
+    n = 2, c = s[0] & 0x1f;
+  else if (s[0] >= 0xe0 && s[0] <= 0xef)
+    n = 3, c = s[0] & 0x0f;
+  else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+    n = 4, c = s[0] & 0x07;
+  else
+    return 0;
+
+  if (n > len)
+    return 0;
+  for (i = 1; i < n; ++i) {
+    if ((s[i] & 0xc0) != 0x80)
+      return 0;
+    c = (c << 6) | (s[i] & 0x3f);
+  }
+
+  /* Reject overlong forms, UTF-16 surrogates and values past U+10FFFF. */
+  if ((n == 3 && c < 0x800) || (n == 4 && c < 0x10000) ||
+      (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+    return 0;
+  return n;
+}
+
+/* Print a string such as a path.  These are usually UTF-8, but Linux
+ * allows any bytes.  A byte which is not part of a valid UTF-8
+ * sequence is printed as a lone surrogate "\udcXX", as Python's
+ * "surrogateescape" error handler does, so that the original bytes
+ * can be recovered.
+ */
+static void
+json_string (const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  size_t i, n;
+
+  json_printf ("\"");
+  for (i = 0; i < len; i += n) {
+    const unsigned char c = p[i];
+
+    n = utf8_sequence_length (&p[i], len - i);
+    if (n == 0) {
+      json_printf ("\\udc%02x", c);
+      n = 1;
+    }
+    else if (c == '"' || c == '\\')
+      json_printf ("\\%c", c);
+    else if (c < 0x20 || c == 0x7f)
+      json_printf ("\\u%04x", c);
+    else if (fwrite (&p[i], 1, n, stdout) != n)
+      error (EXIT_FAILURE, errno, "fwrite");
+  }
+  json_printf ("\"");
+}
+
+/* Print binary data, such as the value of an extended attribute, as
+ * a string of hexadecimal digits.
+ */
+static void
+json_hex (const char *s, size_t len)
+{
+  size_t i;
+
+  json_printf ("\"");
+  for (i = 0; i < len; ++i)
+    json_printf ("%02x", (unsigned char) s[i]);
+  json_printf ("\"");
+}
+
+static void
+json_file (guestfs_h *g, struct file *file)
+{
+  const struct guestfs_statns *stat = file->stat;
+  CLEANUP_FREE char *link = NULL;
+  size_t i;
+
+  json_printf ("{\"path\":");
+  json_string (file->path, strlen (file->path));
+  json_printf (",\"type\":\"%s\",\"mode\":%" PRIi64 ",\"size\":%" PRIi64,
+               file_type (stat->st_mode), stat->st_mode & 07777,
+               stat->st_size);
+
+  if (enable_uids)
+    json_printf (",\"uid\":%" PRIi64 ",\"gid\":%" PRIi64,
+                 stat->st_uid, stat->st_gid);
+
+  if (enable_times) {
+    if (atime)
+      json_printf (",\"atime\":%" PRIi64, stat->st_atime_sec);
+    json_printf (",\"mtime\":%" PRIi64 ",\"ctime\":%" PRIi64,
+                 stat->st_mtime_sec, stat->st_ctime_sec);
+  }
+
+  if (enable_extra_stats)
+    json_printf (",\"dev\":%" PRIi64 ",\"ino\":%" PRIi64
+                 ",\"nlink\":%" PRIi64 ",\"rdev\":%" PRIi64
+                 ",\"blocks\":%" PRIi64,
+                 stat->st_dev, stat->st_ino, stat->st_nlink,
+                 stat->st_rdev, stat->st_blocks);
+
+  if (file->csum) {
+    json_printf (",\"checksum\":");
+    json_string (file->csum, strlen (file->csum));
+  }
+
+  if (guestfs_int_is_lnk (stat->st_mode)) {
+    /* XXX Fix this for NTFS. */
+    link = guestfs_readlink (g, file->path);
+    if (link) {
+      json_printf (",\"link\":");
+      json_string (link, strlen (link));
+    }
+  }
+
+  if (enable_xattrs) {
+    json_printf (",\"xattrs\":{");
+    for (i = 0; i < file->xattrs->len; ++i) {
+      if (i > 0)
+        json_printf (",");
+      json_string (file->xattrs->val[i].attrname,
+                   strlen (file->xattrs->val[i].attrname));
+      json_printf (":");
+      json_hex (file->xattrs->val[i].attrval,
+                file->xattrs->val[i].attrval_len);
+    }
+    json_printf ("}");
+  }
+
+  json_printf ("}");
+}
+
+static void
+json_change (const char *change,
+             guestfs_h *g1, struct file *file1,
+             guestfs_h *g2, struct file *file2)
+{
+  json_printf ("{\"change\":\"%s\"", change);
+  if (file1) {
+    json_printf (",\"old\":");
+    json_file (g1, file1);
+  }
+  if (file2) {
+    json_printf (",\"new\":");
+    json_file (g2, file2);
+  }
+  if (file1 && file2 && STREQ (change, "metadata"))
+    json_changed_fields (file1, file2);
+  json_printf ("}\n");
+}
+
+static void
+json_changed_fields (struct file *file1, struct file *file2)
+{
+  const char *sep = "";
+
+  json_printf (",\"fields\":[");
+#define COMPARE_STAT(n)                                         \
+  if (file1->stat->n != file2->stat->n) {                       \
+    json_printf ("%s\"%s\"", sep, #n);                          \
+    sep = ",";                                                  \
+  }
+  /* See the comment in changed() about st_dev and st_ino. */
+  COMPARE_STAT (st_mode);
+  COMPARE_STAT (st_nlink);
+  COMPARE_STAT (st_uid);
+  COMPARE_STAT (st_gid);
+  COMPARE_STAT (st_rdev);
+  COMPARE_STAT (st_size);
+  COMPARE_STAT (st_blksize);
+  COMPARE_STAT (st_blocks);
+  COMPARE_STAT (st_atime_sec);
+  COMPARE_STAT (st_mtime_sec);
+  COMPARE_STAT (st_ctime_sec);
+#undef COMPARE_STAT
+  if (guestfs_compare_xattr_list (file1->xattrs, file2->xattrs))
+    json_printf ("%s\"xattrs\"", sep);
+  json_printf ("]");
+}
+
 /* Output functions.
  *
  * Note that we have to be careful to check return values from printf
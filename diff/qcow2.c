@@ -0,0 +1,191 @@
+/* virt-diff
+ * Copyright (C) 2013-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Detect a qcow2 overlay which has never been written to, so that
+ * comparing it with its backing file can be skipped altogether.
+ * See docs/interop/qcow2.txt in the qemu sources for the format.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "guestfs-utils.h"
+
+#include "disk-id.h"
+#include "virt-diff.h"
+
+#define QCOW2_MAGIC "QFI\xfb"
+#define QCOW2_HEADER_SIZE 104
+#define QCOW2_L1_OFFSET_MASK UINT64_C (0x00fffffffffffe00)
+
+/* Incompatible features which don't change what is read from an
+ * overlay with no allocated clusters: the dirty bit (refcounts may be
+ * stale), the compression type and extended L2 entries.  Any other
+ * bit, including the corrupt bit, an external data file and bits
+ * added to the format later, means the overlay is not understood.
+ */
+#define QCOW2_INCOMPAT_KNOWN (UINT64_C (1) << 0 | \
+                              UINT64_C (1) << 3 | \
+                              UINT64_C (1) << 4)
+
+/* Get the format and the virtual size of the base image, which was
+ * added with --format 'format' (or NULL to probe it).  Only raw and
+ * qcow2 base images are supported.
+ */
+static bool
+get_base (const char *base, const char *format,
+          const char **format_ret, const char **probed_ret, uint64_t *size_ret)
+{
+  unsigned char header[QCOW2_HEADER_SIZE];
+  struct stat statbuf;
+  const char *probed;
+  bool ret = false;
+  int fd;
+
+  fd = open (base, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  probed = probe_format (fd);
+  if (probed == NULL || fstat (fd, &statbuf) == -1 ||
+      !S_ISREG (statbuf.st_mode))
+    goto out;
+  if (format == NULL)
+    format = probed;
+
+  if (STREQ (format, "raw"))
+    *size_ret = statbuf.st_size;
+  else if (STREQ (format, "qcow2") && STREQ (probed, "qcow2")) {
+    if (pread (fd, header, sizeof header, 0) != sizeof header)
+      goto out;
+    *size_ret = get_be (&header[24], 8);
+  }
+  else
+    goto out;
+
+  *format_ret = format;
+  *probed_ret = probed;
+  ret = true;
+ out:
+  close (fd);
+  return ret;
+}
+
+/* Is the backing file named in the overlay the same file as 'base',
+ * read in the same format?
+ */
+static bool
+backing_file_is (const char *overlay, const char *base,
+                 const char *base_format, const char *base_probed)
+{
+  CLEANUP_FREE char *backing = NULL;
+  CLEANUP_FREE char *backing_format = NULL;
+  struct stat backing_stat, base_stat;
+
+  if (qcow2_backing (overlay, &backing, &backing_format) == -1 ||
+      backing == NULL)
+    return false;
+
+  /* Without a backing format in the overlay, qemu probes it. */
+  if (STRNEQ (backing_format ? backing_format : base_probed, base_format))
+    return false;
+
+  return stat (backing, &backing_stat) == 0 &&
+    stat (base, &base_stat) == 0 &&
+    backing_stat.st_dev == base_stat.st_dev &&
+    backing_stat.st_ino == base_stat.st_ino;
+}
+
+/* Returns true if 'overlay' is a qcow2 file backed directly by 'base',
+ * which was added with --format 'base_format' (or NULL), and no
+ * cluster of the overlay has ever been allocated, so the two disks
+ * have exactly the same content.  Any doubt returns false.
+ */
+bool
+is_unmodified_overlay (const char *overlay,
+                       const char *base, const char *base_format)
+{
+  unsigned char header[QCOW2_HEADER_SIZE];
+  unsigned char l1[4096];
+  const char *format, *probed;
+  uint64_t base_size, version, l1_size, l1_offset, incompat = 0;
+  uint64_t i, j, n;
+  bool ret = false;
+  int fd;
+
+  if (!get_base (base, base_format, &format, &probed, &base_size))
+    return false;
+
+  fd = open (overlay, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  if (pread (fd, header, sizeof header, 0) != sizeof header ||
+      memcmp (header, QCOW2_MAGIC, 4) != 0)
+    goto out;
+
+  version = get_be (&header[4], 4);
+  if (version < 2)
+    goto out;
+  if (version >= 3)
+    incompat = get_be (&header[72], 8);
+  if (incompat & ~QCOW2_INCOMPAT_KNOWN)
+    goto out;
+  if (get_be (&header[32], 4) != 0) /* Encrypted. */
+    goto out;
+
+  /* A larger overlay reads zeroes past the end of the base, and a
+   * smaller one truncates it.
+   */
+  if (get_be (&header[24], 8) != base_size)
+    goto out;
+
+  if (!backing_file_is (overlay, base, format, probed))
+    goto out;
+
+  /* If every L1 table entry is empty then there are no L2 tables,
+   * so every read falls through to the backing file.
+   */
+  l1_size = get_be (&header[36], 4);
+  l1_offset = get_be (&header[40], 8);
+  for (i = 0; i < l1_size; i += n) {
+    n = l1_size - i;
+    if (n > sizeof l1 / 8)
+      n = sizeof l1 / 8;
+    if (pread (fd, l1, n * 8, l1_offset + i * 8) != (ssize_t) (n * 8))
+      goto out;
+    for (j = 0; j < n; ++j) {
+      if (get_be (&l1[j * 8], 8) & QCOW2_L1_OFFSET_MASK)
+        goto out;
+    }
+  }
+
+  ret = true;
+ out:
+  close (fd);
+  return ret;
+}
@@ -55,4 +55,77 @@ if [ "$output" != "$expected" ]; then
     exit 1
 fi
 
-rm fedora.qcow2
+output="$($VG virt-diff --json --format=raw -a ../test-data/phony-guests/fedora.img --format=qcow2 -A fedora.qcow2)"
+
+expected="\
+{\"change\":\"added\",\"new\":{\"path\":\"/diff\",\"type\":\"-\",\"mode\":420,\"size\":0}}
+{\"change\":\"content\",\"old\":{\"path\":\"/etc/motd\",\"type\":\"-\",\"mode\":420,\"size\":37},\"new\":{\"path\":\"/etc/motd\",\"type\":\"-\",\"mode\":420,\"size\":55}}"
+
+if [ "$output" != "$expected" ]; then
+    echo "$0: error: unexpected output from virt-diff --json"
+    echo "---- output: ------------------------------------------"
+    echo "$output"
+    echo "---- expected: ----------------------------------------"
+    echo "$expected"
+    echo "-------------------------------------------------------"
+    exit 1
+fi
+
+# Binary extended attributes and file names which are not UTF-8
+# must still give valid JSON.
+rm -f fedora-json.qcow2
+guestfish -- \
+  disk-create fedora-json.qcow2 qcow2 -1 \
+    backingfile:../test-data/phony-guests/fedora.img backingformat:raw
+
+guestfish --format=qcow2 -a fedora-json.qcow2 -i <<EOF
+touch "/bad\xff"
+setxattr user.test "\xff\xfe\x01" 3 /etc/motd
+EOF
+
+output="$($VG virt-diff --json --xattrs --format=raw -a ../test-data/phony-guests/fedora.img --format=qcow2 -A fedora-json.qcow2)"
+
+if ! grep -qF '"path":"/bad\udcff"' <<<"$output" ||
+   ! grep -qF '"user.test":"fffe01"' <<<"$output"; then
+    echo "$0: error: unexpected output from virt-diff --json --xattrs"
+    echo "$output"
+    exit 1
+fi
+
+# An overlay which has never been written to is detected without
+# launching the appliance, but not if it is larger than its backing
+# file or names a different backing format.
+rm -f fedora-clean.qcow2 fedora-larger.qcow2 fedora-badfmt.qcow2
+size="$(stat -c %s ../test-data/phony-guests/fedora.img)"
+guestfish -- \
+  disk-create fedora-clean.qcow2 qcow2 -1 \
+    backingfile:../test-data/phony-guests/fedora.img backingformat:raw : \
+  disk-create fedora-larger.qcow2 qcow2 $((size + 1048576)) \
+    backingfile:../test-data/phony-guests/fedora.img backingformat:raw : \
+  disk-create fedora-badfmt.qcow2 qcow2 $size \
+    backingfile:../test-data/phony-guests/fedora.img backingformat:qcow2
+
+$VG virt-diff -v --format=raw -a ../test-data/phony-guests/fedora.img \
+    --format=qcow2 -A fedora-clean.qcow2 > diff-clean.out 2> diff-clean.log
+grep "snapshot has not been modified" diff-clean.log
+test ! -s diff-clean.out
+
+$VG virt-diff -v --format=raw -a ../test-data/phony-guests/fedora.img \
+    --format=qcow2 -A fedora-larger.qcow2 > /dev/null 2> diff-larger.log
+if grep "snapshot has not been modified" diff-larger.log; then
+    echo "$0: error: larger overlay treated as unmodified"
+    exit 1
+fi
+
+# The appliance cannot open this overlay, so virt-diff fails, but it
+# must not be skipped.
+if $VG virt-diff -v --format=raw -a ../test-data/phony-guests/fedora.img \
+       --format=qcow2 -A fedora-badfmt.qcow2 2>&1 |
+       grep "snapshot has not been modified"; then
+    echo "$0: error: overlay with the wrong backing format treated as unmodified"
+    exit 1
+fi
+
+rm fedora-clean.qcow2 fedora-larger.qcow2 fedora-badfmt.qcow2
+rm diff-clean.out diff-clean.log diff-larger.log
+rm fedora.qcow2 fedora-json.qcow2
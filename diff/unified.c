@@ -0,0 +1,464 @@
+/* virt-diff
+ * Copyright (C) 2013-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Unified diff of two files held in memory.
+ *
+ * This uses the linear space variation of the algorithm in Eugene
+ * W. Myers, "An O(ND) Difference Algorithm and Its Variations",
+ * Algorithmica 1 (1986), the same as GNU diff.  As in GNU diff, the
+ * search for each midpoint gives up after a number of edits which
+ * grows with the square root of the size of the files, and uses the
+ * furthest point reached instead.  The diff is then still correct,
+ * but may not be the shortest one.  Without this, two large files
+ * with few lines in common take O(N^2) time.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#include "virt-diff.h"
+
+/* Lines of context around each hunk, as for 'diff -u'. */
+#define CONTEXT 3
+
+struct line {
+  const char *p;
+  size_t len;                   /* Including the final '\n', if any. */
+  uint64_t hash;
+};
+
+struct file {
+  struct line *lines;
+  size_t nr_lines;
+  bool *changed;                /* Line deleted or inserted. */
+};
+
+struct compare {
+  const struct line *a, *b;     /* Lines left after discard_unmatched. */
+  const size_t *amap, *bmap;    /* Line numbers of those in the files. */
+  bool *deleted, *inserted;
+  ssize_t *fdiag, *bdiag;       /* Furthest reaching paths, by diagonal. */
+  ssize_t too_expensive;        /* Edit cost at which to give up. */
+};
+
+static void
+split_lines (struct file *f, const char *content, size_t len)
+{
+  const char *p = content, *end = content + len;
+  size_t allocated = 0;
+
+  f->lines = NULL;
+  f->nr_lines = 0;
+
+  while (p < end) {
+    const char *nl = memchr (p, '\n', end - p);
+    const char *next = nl ? nl + 1 : end;
+    struct line *line;
+    const char *q;
+
+    if (f->nr_lines >= allocated) {
+      allocated = allocated == 0 ? 256 : allocated * 2;
+      f->lines = realloc (f->lines, allocated * sizeof (struct line));
+      if (f->lines == NULL)
+        error (EXIT_FAILURE, errno, "realloc");
+    }
+    line = &f->lines[f->nr_lines++];
+    line->p = p;
+    line->len = next - p;
+
+    /* 64 bit FNV-1a. */
+    line->hash = UINT64_C (0xcbf29ce484222325);
+    for (q = p; q < next; ++q) {
+      line->hash ^= (unsigned char) *q;
+      line->hash *= UINT64_C (0x100000001b3);
+    }
+
+    p = next;
+  }
+
+  f->changed = calloc (f->nr_lines + 1, sizeof (bool));
+  if (f->changed == NULL)
+    error (EXIT_FAILURE, errno, "calloc");
+}
+
+static int
+compare_hashes (const void *h1v, const void *h2v)
+{
+  const uint64_t h1 = *(const uint64_t *) h1v;
+  const uint64_t h2 = *(const uint64_t *) h2v;
+
+  return h1 < h2 ? -1 : h1 > h2;
+}
+
+/* A line which does not occur anywhere in the other file is always
+ * deleted or inserted, so mark it now and leave it out of the
+ * search.  This does not change the result, but files which have
+ * few lines in common (eg. logs) become much quicker to compare.
+ * Returns the number of lines left, which are copied to *lines_ret
+ * with their line numbers in 'f' in *map_ret.
+ */
+static size_t
+discard_unmatched (struct file *f, const struct file *other,
+                   struct line **lines_ret, size_t **map_ret)
+{
+  uint64_t *hashes;
+  struct line *lines;
+  size_t *map;
+  size_t i, n = 0;
+
+  hashes = malloc ((other->nr_lines + 1) * sizeof (uint64_t));
+  lines = malloc ((f->nr_lines + 1) * sizeof (struct line));
+  map = malloc ((f->nr_lines + 1) * sizeof (size_t));
+  if (hashes == NULL || lines == NULL || map == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  for (i = 0; i < other->nr_lines; ++i)
+    hashes[i] = other->lines[i].hash;
+  qsort (hashes, other->nr_lines, sizeof (uint64_t), compare_hashes);
+
+  for (i = 0; i < f->nr_lines; ++i) {
+    if (bsearch (&f->lines[i].hash, hashes, other->nr_lines,
+                 sizeof (uint64_t), compare_hashes) == NULL)
+      f->changed[i] = true;
+    else {
+      lines[n] = f->lines[i];
+      map[n++] = i;
+    }
+  }
+
+  free (hashes);
+  *lines_ret = lines;
+  *map_ret = map;
+  return n;
+}
+
+static inline bool
+line_eq (const struct line *l1, const struct line *l2)
+{
+  return l1->hash == l2->hash && l1->len == l2->len &&
+    memcmp (l1->p, l2->p, l1->len) == 0;
+}
+
+/* Find the midpoint of the shortest edit script for a[xoff..xlim)
+ * and b[yoff..ylim), by extending paths forwards from the start and
+ * backwards from the end until they overlap, or until the cost
+ * reaches c->too_expensive.
+ */
+static void
+find_middle_snake (struct compare *c,
+                   ssize_t xoff, ssize_t xlim, ssize_t yoff, ssize_t ylim,
+                   ssize_t *xmid, ssize_t *ymid)
+{
+  ssize_t *const fd = c->fdiag;
+  ssize_t *const bd = c->bdiag;
+  const ssize_t dmin = xoff - ylim;
+  const ssize_t dmax = xlim - yoff;
+  const ssize_t fmid = xoff - yoff;
+  const ssize_t bmid = xlim - ylim;
+  ssize_t fmin = fmid, fmax = fmid;
+  ssize_t bmin = bmid, bmax = bmid;
+  const bool odd = (fmid - bmid) & 1;
+  ssize_t cost, d, x, y;
+
+  fd[fmid] = xoff;
+  bd[bmid] = xlim;
+
+  for (cost = 1;; ++cost) {
+    /* Extend the forward paths by one edit. */
+    if (fmin > dmin)
+      fd[--fmin - 1] = -1;
+    else
+      ++fmin;
+    if (fmax < dmax)
+      fd[++fmax + 1] = -1;
+    else
+      --fmax;
+    for (d = fmax; d >= fmin; d -= 2) {
+      const ssize_t tlo = fd[d - 1], thi = fd[d + 1];
+
+      x = tlo >= thi ? tlo + 1 : thi;
+      y = x - d;
+      while (x < xlim && y < ylim && line_eq (&c->a[x], &c->b[y]))
+        x++, y++;
+      fd[d] = x;
+      if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+        *xmid = x;
+        *ymid = y;
+        return;
+      }
+    }
+
+    /* Extend the backward paths by one edit. */
+    if (bmin > dmin)
+      bd[--bmin - 1] = SSIZE_MAX;
+    else
+      ++bmin;
+    if (bmax < dmax)
+      bd[++bmax + 1] = SSIZE_MAX;
+    else
+      --bmax;
+    for (d = bmax; d >= bmin; d -= 2) {
+      const ssize_t tlo = bd[d - 1], thi = bd[d + 1];
+
+      x = tlo < thi ? tlo : thi - 1;
+      y = x - d;
+      while (xoff < x && yoff < y && line_eq (&c->a[x - 1], &c->b[y - 1]))
+        x--, y--;
+      bd[d] = x;
+      if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+        *xmid = x;
+        *ymid = y;
+        return;
+      }
+    }
+
+    if (cost >= c->too_expensive) {
+      ssize_t fxybest = -1, fxbest = 0, bxybest = SSIZE_MAX, bxbest = 0;
+
+      /* Find the forward path which got furthest (maximum x + y) and
+       * the backward path which got furthest (minimum x + y), and
+       * split at whichever of the two made more progress.
+       */
+      for (d = fmax; d >= fmin; d -= 2) {
+        x = fd[d] < xlim ? fd[d] : xlim;
+        y = x - d;
+        if (y > ylim) {
+          x = ylim + d;
+          y = ylim;
+        }
+        if (x + y > fxybest) {
+          fxybest = x + y;
+          fxbest = x;
+        }
+      }
+      for (d = bmax; d >= bmin; d -= 2) {
+        x = bd[d] > xoff ? bd[d] : xoff;
+        y = x - d;
+        if (y < yoff) {
+          x = yoff + d;
+          y = yoff;
+        }
+        if (x + y < bxybest) {
+          bxybest = x + y;
+          bxbest = x;
+        }
+      }
+
+      if ((xlim + ylim) - bxybest < fxybest - (xoff + yoff)) {
+        *xmid = fxbest;
+        *ymid = fxybest - fxbest;
+      }
+      else {
+        *xmid = bxbest;
+        *ymid = bxybest - bxbest;
+      }
+      return;
+    }
+  }
+}
+
+/* Mark the lines of a[xoff..xlim) which must be deleted and the
+ * lines of b[yoff..ylim) which must be inserted.
+ */
+static void
+compare_seq (struct compare *c,
+             ssize_t xoff, ssize_t xlim, ssize_t yoff, ssize_t ylim)
+{
+  ssize_t xmid, ymid;
+
+  /* Skip over any common prefix and suffix. */
+  while (xoff < xlim && yoff < ylim && line_eq (&c->a[xoff], &c->b[yoff]))
+    xoff++, yoff++;
+  while (xoff < xlim && yoff < ylim &&
+         line_eq (&c->a[xlim - 1], &c->b[ylim - 1]))
+    xlim--, ylim--;
+
+  if (xoff == xlim) {
+    while (yoff < ylim)
+      c->inserted[c->bmap[yoff++]] = true;
+  }
+  else if (yoff == ylim) {
+    while (xoff < xlim)
+      c->deleted[c->amap[xoff++]] = true;
+  }
+  else {
+    find_middle_snake (c, xoff, xlim, yoff, ylim, &xmid, &ymid);
+    compare_seq (c, xoff, xmid, yoff, ymid);
+    compare_seq (c, xmid, xlim, ymid, ylim);
+  }
+}
+
+static void
+print_range (char sign, size_t start, size_t count)
+{
+  int r;
+
+  /* Same format as GNU diff: an empty range is shown as the line
+   * before it, and a single line has no count.
+   */
+  if (count == 0)
+    r = printf ("%c%zu,0", sign, start);
+  else if (count == 1)
+    r = printf ("%c%zu", sign, start + 1);
+  else
+    r = printf ("%c%zu,%zu", sign, start + 1, count);
+  if (r < 0)
+    error (EXIT_FAILURE, errno, "printf");
+}
+
+static void
+print_line (char prefix, const struct line *line)
+{
+  if (putchar (prefix) == EOF ||
+      fwrite (line->p, 1, line->len, stdout) != line->len)
+    error (EXIT_FAILURE, errno, "fwrite");
+  if (line->len == 0 || line->p[line->len - 1] != '\n') {
+    if (printf ("\n\\ No newline at end of file\n") < 0)
+      error (EXIT_FAILURE, errno, "printf");
+  }
+}
+
+/* Print the hunks of a unified diff between the two buffers, without
+ * the '---' and '+++' header lines.
+ */
+void
+print_unified_diff (const char *content1, size_t len1,
+                    const char *content2, size_t len2)
+{
+  struct file f1, f2;
+  struct compare c;
+  struct line *lines1, *lines2;
+  size_t *map1, *map2;
+  ssize_t *diags;
+  size_t i, j, n, n1, n2;
+
+  split_lines (&f1, content1, len1);
+  split_lines (&f2, content2, len2);
+
+  n1 = discard_unmatched (&f1, &f2, &lines1, &map1);
+  n2 = discard_unmatched (&f2, &f1, &lines2, &map2);
+
+  /* Diagonals range from -n2-1 to n1+1. */
+  diags = malloc (2 * (n1 + n2 + 3) * sizeof (ssize_t));
+  if (diags == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  c.a = lines1;
+  c.b = lines2;
+  c.amap = map1;
+  c.bmap = map2;
+  c.deleted = f1.changed;
+  c.inserted = f2.changed;
+  c.fdiag = diags + n2 + 1;
+  c.bdiag = c.fdiag + n1 + n2 + 3;
+
+  /* About the square root of the number of diagonals, but at least
+   * 4096, as GNU diff does.
+   */
+  c.too_expensive = 1;
+  for (n = n1 + n2 + 3; n != 0; n >>= 2)
+    c.too_expensive <<= 1;
+  if (c.too_expensive < 4096)
+    c.too_expensive = 4096;
+
+  compare_seq (&c, 0, n1, 0, n2);
+
+  free (diags);
+  free (lines1);
+  free (map1);
+  free (lines2);
+  free (map2);
+
+  i = j = 0;
+  for (;;) {
+    size_t start1, start2, end1, end2, common, x, y;
+
+    /* Find the next change. */
+    while (i < f1.nr_lines && j < f2.nr_lines &&
+           !f1.changed[i] && !f2.changed[j])
+      i++, j++;
+    if (i == f1.nr_lines && j == f2.nr_lines)
+      break;
+
+    start1 = i > CONTEXT ? i - CONTEXT : 0;
+    start2 = j - (i - start1);
+
+    /* Extend the hunk over following changes, until there are more
+     * than 2*CONTEXT unchanged lines in a row.
+     */
+    end1 = i;
+    end2 = j;
+    for (;;) {
+      while (end1 < f1.nr_lines && f1.changed[end1])
+        end1++;
+      while (end2 < f2.nr_lines && f2.changed[end2])
+        end2++;
+      common = 0;
+      while (end1 + common < f1.nr_lines && end2 + common < f2.nr_lines &&
+             !f1.changed[end1 + common] && !f2.changed[end2 + common])
+        common++;
+      if (common > 2 * CONTEXT ||
+          (end1 + common == f1.nr_lines && end2 + common == f2.nr_lines))
+        break;
+      end1 += common;
+      end2 += common;
+    }
+    if (common > CONTEXT)
+      common = CONTEXT;
+    end1 += common;
+    end2 += common;
+
+    if (printf ("@@ ") < 0)
+      error (EXIT_FAILURE, errno, "printf");
+    print_range ('-', start1, end1 - start1);
+    if (putchar (' ') == EOF)
+      error (EXIT_FAILURE, errno, "putchar");
+    print_range ('+', start2, end2 - start2);
+    if (printf (" @@\n") < 0)
+      error (EXIT_FAILURE, errno, "printf");
+
+    x = start1;
+    y = start2;
+    while (x < end1 || y < end2) {
+      if (x < end1 && f1.changed[x])
+        print_line ('-', &f1.lines[x++]);
+      else if (y < end2 && f2.changed[y])
+        print_line ('+', &f2.lines[y++]);
+      else {
+        print_line (' ', &f1.lines[x]);
+        x++, y++;
+      }
+    }
+
+    i = end1;
+    j = end2;
+  }
+
+  free (f1.lines);
+  free (f1.changed);
+  free (f2.lines);
+  free (f2.changed);
+}
@@ -0,0 +1,28 @@
+/* virt-diff
+ * Copyright (C) 2013-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GUESTFS_VIRT_DIFF_H_
+#define GUESTFS_VIRT_DIFF_H_
+
+/* qcow2.c */
+extern bool is_unmodified_overlay (const char *overlay, const char *base, const char *base_format);
+
+/* unified.c */
+extern void print_unified_diff (const char *content1, size_t len1, const char *content2, size_t len2);
+
+#endif /* GUESTFS_VIRT_DIFF_H_ */
@@ -0,0 +1,282 @@
+/* Identify local disk images from the host
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* These functions are shared by the tools which keep results on the
+ * host between runs (virt-inspector --cache, virt-ls --index), or
+ * which look inside disk images without launching the appliance.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "guestfs.h"
+#include "guestfs-utils.h"
+#include "options.h"
+
+#include "disk-id.h"
+
+#define QCOW2_MAGIC "QFI\xfb"
+#define QCOW2_EXT_BACKING_FORMAT UINT32_C (0xe2792aca)
+
+uint64_t
+get_be (const unsigned char *p, size_t len)
+{
+  uint64_t r = 0;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    r = (r << 8) | p[i];
+  return r;
+}
+
+/* Update a 64 bit FNV-1a hash. */
+void
+hash_update (uint64_t *h, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    *h ^= p[i];
+    *h *= UINT64_C (0x100000001b3);
+  }
+}
+
+void
+hash_string (uint64_t *h, const char *str)
+{
+  if (str == NULL)
+    str = "";
+  hash_update (h, str, strlen (str) + 1);
+}
+
+/* Return the format that qemu would probe for the disk image open on
+ * 'fd', or "raw" if none of these signatures is found.  Only the
+ * formats which are likely to be met are checked, so a rarely used
+ * format (eg. dmg or parallels) is reported as "raw" too.  Returns
+ * NULL if the image cannot be read.
+ */
+const char *
+probe_format (int fd)
+{
+  unsigned char buf[128];
+  ssize_t r;
+
+  r = pread (fd, buf, sizeof buf, 0);
+  if (r == -1)
+    return NULL;
+  if (r < (ssize_t) sizeof buf)
+    memset (&buf[r], 0, sizeof buf - r);
+
+  if (memcmp (buf, QCOW2_MAGIC, 4) == 0)
+    return get_be (&buf[4], 4) >= 2 ? "qcow2" : "qcow";
+  if (memcmp (buf, "QFI\0", 4) == 0)
+    return "qed";
+  if (memcmp (buf, "KDMV", 4) == 0 || memcmp (buf, "COWD", 4) == 0 ||
+      memcmp (buf, "# Disk DescriptorFile", 21) == 0)
+    return "vmdk";
+  if (get_be (&buf[64], 4) == UINT32_C (0xbeda107f))
+    return "vdi";
+  if (memcmp (buf, "vhdxfile", 8) == 0)
+    return "vhdx";
+  if (memcmp (buf, "conectix", 8) == 0)
+    return "vpc";
+  if (memcmp (buf, "LUKS\xba\xbe", 6) == 0)
+    return "luks";
+  return "raw";
+}
+
+/* Read the backing format header extension, which is stored between
+ * the header and the end of the first cluster.
+ */
+static char *
+read_backing_format (int fd, const unsigned char *header)
+{
+  const uint64_t version = get_be (&header[4], 4);
+  const uint64_t cluster_size = UINT64_C (1) << (get_be (&header[20], 4) & 63);
+  uint64_t offset = version >= 3 ? get_be (&header[100], 4) : 72;
+  unsigned char ext[8];
+  char *ret;
+  int i;
+
+  for (i = 0; i < 64 && offset + sizeof ext <= cluster_size; ++i) {
+    uint32_t type, len;
+
+    if (pread (fd, ext, sizeof ext, offset) != sizeof ext)
+      return NULL;
+    type = get_be (&ext[0], 4);
+    len = get_be (&ext[4], 4);
+    if (type == 0)
+      return NULL;
+    if (type == QCOW2_EXT_BACKING_FORMAT) {
+      if (len == 0 || len > 256)
+        return NULL;
+      ret = malloc (len + 1);
+      if (ret == NULL)
+        error (EXIT_FAILURE, errno, "malloc");
+      if (pread (fd, ret, len, offset + sizeof ext) != (ssize_t) len) {
+        free (ret);
+        return NULL;
+      }
+      ret[len] = '\0';
+      return ret;
+    }
+    offset += sizeof ext + ((len + 7) & ~UINT32_C (7));
+  }
+
+  return NULL;
+}
+
+/* Read the backing file of the qcow2 image 'filename'.  A relative
+ * backing file name is returned relative to the directory of
+ * 'filename'.  If 'format' is not NULL, the backing format recorded
+ * in the image (or NULL if none is recorded) is returned there too.
+ *
+ * Returns 0 on success, with '*backing' set to NULL if 'filename'
+ * is not a qcow2 image or has no backing file.  Returns -1 if the
+ * image cannot be read or the backing file is not a plain local
+ * file (eg. "json:" or a URL).
+ */
+int
+qcow2_backing (const char *filename, char **backing, char **format)
+{
+  unsigned char header[104];
+  uint64_t backing_offset;
+  uint32_t backing_size;
+  char name[1024];
+  const char *slash;
+  int fd;
+
+  *backing = NULL;
+  if (format)
+    *format = NULL;
+
+  fd = open (filename, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  if (pread (fd, header, sizeof header, 0) != sizeof header ||
+      memcmp (header, QCOW2_MAGIC, 4) != 0) {
+    close (fd);
+    return 0;
+  }
+
+  backing_offset = get_be (&header[8], 8);
+  backing_size = get_be (&header[16], 4);
+  if (backing_offset == 0 || backing_size == 0) {
+    close (fd);
+    return 0;
+  }
+  if (backing_size >= sizeof name ||
+      pread (fd, name, backing_size, backing_offset) != backing_size) {
+    close (fd);
+    return -1;
+  }
+  name[backing_size] = '\0';
+
+  /* Only plain local files can be checked. */
+  if (STRPREFIX (name, "json:") || strstr (name, "://") != NULL) {
+    close (fd);
+    return -1;
+  }
+
+  if (format)
+    *format = read_backing_format (fd, header);
+  close (fd);
+
+  /* Relative backing file names are relative to the overlay. */
+  slash = strrchr (filename, '/');
+  if (name[0] == '/' || slash == NULL)
+    *backing = strdup (name);
+  else if (asprintf (backing, "%.*s/%s",
+                     (int) (slash - filename), filename, name) == -1)
+    *backing = NULL;
+  if (*backing == NULL)
+    error (EXIT_FAILURE, errno, "strdup");
+  return 0;
+}
+
+/* Add the identity of a disk image to the hash: its real path, inode
+ * and size, and its modification and change times.  If the image is
+ * a qcow2 file with a backing file, follow the backing chain too,
+ * since a change anywhere in the chain changes the guest.
+ *
+ * Returns -1 if the image cannot be identified this way (eg. it is a
+ * block device, whose contents can change without updating any
+ * timestamps, or it has a network backing file).
+ */
+static int
+hash_disk (uint64_t *h, const char *filename, int depth)
+{
+  CLEANUP_FREE char *path = NULL;
+  CLEANUP_FREE char *backing = NULL;
+  struct stat statbuf;
+
+  if (depth > 16)
+    return -1;
+
+  path = realpath (filename, NULL);
+  if (path == NULL || stat (path, &statbuf) == -1 || !S_ISREG (statbuf.st_mode))
+    return -1;
+
+  hash_update (h, path, strlen (path) + 1);
+  hash_update (h, &statbuf.st_dev, sizeof statbuf.st_dev);
+  hash_update (h, &statbuf.st_ino, sizeof statbuf.st_ino);
+  hash_update (h, &statbuf.st_size, sizeof statbuf.st_size);
+  hash_update (h, &statbuf.st_mtim.tv_sec, sizeof statbuf.st_mtim.tv_sec);
+  hash_update (h, &statbuf.st_mtim.tv_nsec, sizeof statbuf.st_mtim.tv_nsec);
+  hash_update (h, &statbuf.st_ctim.tv_sec, sizeof statbuf.st_ctim.tv_sec);
+  hash_update (h, &statbuf.st_ctim.tv_nsec, sizeof statbuf.st_ctim.tv_nsec);
+
+  if (qcow2_backing (path, &backing, NULL) == -1)
+    return -1;
+  if (backing == NULL)
+    return 0;
+  return hash_disk (h, backing, depth+1);
+}
+
+/* Only local disk images added with -a can be identified, since
+ * there is no cheap way to tell if a libvirt guest or a remote disk
+ * has changed.
+ */
+int
+hash_drives (uint64_t *h, struct drv *drvs)
+{
+  struct drv *drv;
+
+  for (drv = drvs; drv != NULL; drv = drv->next) {
+    if (drv->type != drv_a)
+      return -1;
+
+    hash_string (h, drv->a.format);
+    hash_update (h, &drv->a.blocksize, sizeof drv->a.blocksize);
+    if (hash_disk (h, drv->a.filename, 0) == -1)
+      return -1;
+  }
+
+  return 0;
+}
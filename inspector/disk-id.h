@@ -0,0 +1,47 @@
+/* Identify local disk images from the host
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GUESTFS_DISK_ID_H
+#define GUESTFS_DISK_ID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct drv;
+
+/* The initial value of a 64 bit FNV-1a hash. */
+#define HASH_INIT UINT64_C (0xcbf29ce484222325)
+
+/* Read a big endian number of 'len' bytes. */
+extern uint64_t get_be (const unsigned char *p, size_t len);
+
+extern void hash_update (uint64_t *h, const void *data, size_t len);
+extern void hash_string (uint64_t *h, const char *str);
+
+/* Add the identity of every drive to the hash.  Returns -1 if any
+ * drive cannot be identified cheaply, see disk-id.c.
+ */
+extern int hash_drives (uint64_t *h, struct drv *drvs);
+
+/* Guess the format of a disk image from its signature. */
+extern const char *probe_format (int fd);
+
+/* Read the backing file name and format of a qcow2 image. */
+extern int qcow2_backing (const char *filename, char **backing, char **format);
+
+#endif /* GUESTFS_DISK_ID_H */
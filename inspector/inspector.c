@@ -23,12 +23,14 @@
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <locale.h>
 #include <assert.h>
 #include <libintl.h>
+#include <sys/stat.h>
 
 #include <libxml/xmlIO.h>
 #include <libxml/xmlwriter.h>
@@ -46,6 +48,8 @@
 #include "libxml2-writer-macros.h"
 #include "utils.h"
 
+#include "disk-id.h"
+
 /* Currently open libguestfs handle. */
 guestfs_h *g;
 
@@ -60,8 +64,11 @@ int in_virt_rescue = 0;
 static const char *xpath = NULL;
 static int inspect_apps = 1;
 static int inspect_icon = 1;
+static const char *cache_dir = NULL;
 
-static void output (char **roots);
+static char *cache_filename (struct drv *drvs);
+static void copy_to_stdout (int fd);
+static void output (int fd, char **roots);
 static void output_roots (xmlTextWriterPtr xo, char **roots);
 static void output_root (xmlTextWriterPtr xo, char *root);
 static void output_mountpoints (xmlTextWriterPtr xo, char *root);
@@ -94,6 +101,7 @@ usage (int status)
               "  -a|--add image       Add image\n"
               "  --blocksize[=512|4096]\n"
               "                       Set sector size of the disk for -a option\n"
+              "  --cache dir          Cache inspection results in dir\n"
               "  -c|--connect uri     Specify libvirt URI for -d option\n"
               "  -d|--domain guest    Add disks from libvirt guest\n"
               "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -127,6 +135,7 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
     { "blocksize", 2, 0, 0 },
+    { "cache", 1, 0, 0 },
     { "connect", 1, 0, 'c' },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -152,6 +161,9 @@ main (int argc, char *argv[])
   int c;
   int option_index;
   struct key_store *ks = NULL;
+  CLEANUP_FREE char *cache_file = NULL;
+  CLEANUP_FREE char *cache_tmp = NULL;
+  int out_fd = STDOUT_FILENO;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -183,6 +195,8 @@ main (int argc, char *argv[])
         inspect_icon = 0;
       } else if (STREQ (long_options[option_index].name, "key")) {
         OPTION_key;
+      } else if (STREQ (long_options[option_index].name, "cache")) {
+        cache_dir = optarg;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -290,6 +304,38 @@ main (int argc, char *argv[])
     usage (EXIT_FAILURE);
   }
 
+  /* If the output for exactly these disk images is already in the
+   * cache, we don't need to launch the appliance at all.  Otherwise
+   * the XML is written to a temporary file in the cache directory and
+   * renamed into place once it is complete.
+   */
+  if (cache_dir) {
+    if (ks != NULL) {
+      if (verbose)
+        fprintf (stderr, "%s: not using the cache because --key was given\n",
+                 getprogname ());
+    } else
+      cache_file = cache_filename (drvs);
+
+    if (cache_file) {
+      int fd = open (cache_file, O_RDONLY|O_CLOEXEC);
+
+      if (fd >= 0) {
+        if (verbose)
+          fprintf (stderr, "%s: using cached inspection data %s\n",
+                   getprogname (), cache_file);
+        copy_to_stdout (fd);
+        close (fd);
+        free_drives (drvs);
+        guestfs_close (g);
+        exit (EXIT_SUCCESS);
+      }
+      if (errno != ENOENT)
+        perror (cache_file);
+    } else if (verbose)
+      fprintf (stderr, "%s: these disks cannot be cached\n", getprogname ());
+  }
+
   /* Add drives, inspect and mount.  Note that inspector is always true,
    * and there is no -m option.
    */
@@ -318,21 +364,88 @@ main (int argc, char *argv[])
       error (EXIT_FAILURE, 0,
              _("no operating system could be detected inside this disk image.\n\nThis may be because the file is not a disk image, or is not a virtual machine\nimage, or because the OS type is not understood by libguestfs.\n\nNOTE for Red Hat Enterprise Linux 6 users: for Windows guest support you must\ninstall the separate libguestfs-winsupport package.\n\nIf you feel this is an error, please file a bug report including as much\ninformation about the disk image as possible.\n"));
 
-    output (roots);
+    if (cache_file) {
+      if (asprintf (&cache_tmp, "%s/.tmpXXXXXX", cache_dir) == -1)
+        error (EXIT_FAILURE, errno, "asprintf");
+      out_fd = mkstemp (cache_tmp);
+      if (out_fd == -1) {
+        /* Don't lose the result of inspection just because it
+         * cannot be cached.
+         */
+        fprintf (stderr, _("%s: warning: cannot write to the cache: %s: %m\n"),
+                 getprogname (), cache_tmp);
+        free (cache_file);
+        cache_file = NULL;
+        out_fd = STDOUT_FILENO;
+      }
+    }
+
+    output (out_fd, roots);
   }
 
   guestfs_close (g);
 
+  if (cache_file) {
+    if (fsync (out_fd) == -1 || rename (cache_tmp, cache_file) == -1) {
+      perror (cache_file);
+      unlink (cache_tmp);
+    }
+    if (lseek (out_fd, 0, SEEK_SET) == -1)
+      error (EXIT_FAILURE, errno, "lseek");
+    copy_to_stdout (out_fd);
+    close (out_fd);
+  }
+
   exit (EXIT_SUCCESS);
 }
 
+/* Return the name of the cache file for this set of drives, or NULL
+ * if they cannot be cached.  Only local disk images added with -a
+ * can be cached, since there is no cheap way to tell if a libvirt
+ * guest or a remote disk has changed.
+ */
+static char *
+cache_filename (struct drv *drvs)
+{
+  uint64_t h = HASH_INIT;
+  char *ret;
+
+  /* The XML produced may change between versions, and depends on
+   * which parts of the output were requested.
+   */
+  hash_string (&h, PACKAGE_VERSION);
+  hash_update (&h, &inspect_apps, sizeof inspect_apps);
+  hash_update (&h, &inspect_icon, sizeof inspect_icon);
+
+  if (hash_drives (&h, drvs) == -1)
+    return NULL;
+
+  if (asprintf (&ret, "%s/%016" PRIx64 ".xml", cache_dir, h) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  return ret;
+}
+
+static void
+copy_to_stdout (int fd)
+{
+  char buf[BUFSIZ];
+  ssize_t r;
+
+  while ((r = read (fd, buf, sizeof buf)) > 0) {
+    if (fwrite (buf, 1, r, stdout) != (size_t) r)
+      error (EXIT_FAILURE, errno, "write");
+  }
+  if (r == -1)
+    error (EXIT_FAILURE, errno, "read");
+}
+
 static void
-output (char **roots)
+output (int fd, char **roots)
 {
-  xmlOutputBufferPtr ob = xmlOutputBufferCreateFd (1, NULL);
+  xmlOutputBufferPtr ob = xmlOutputBufferCreateFd (fd, NULL);
   if (ob == NULL)
     error (EXIT_FAILURE, 0,
-           _("xmlOutputBufferCreateFd: failed to open stdout"));
+           _("xmlOutputBufferCreateFd: failed to open output"));
 
   /* 'ob' is freed when 'xo' is freed.. */
   CLEANUP_XMLFREETEXTWRITER xmlTextWriterPtr xo = xmlNewTextWriter (ob);
@@ -0,0 +1,192 @@
+/* Cache the filesystems mounted by inspection
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* virt-cat, virt-log and virt-tail only need inspection to find out
+ * which filesystems to mount where.  With --cache, that is saved on
+ * the host the first time, so that later runs on the same disk
+ * images can skip guestfs_inspect_os, which is much slower than
+ * mounting.
+ *
+ * The cache file has the type of the operating system on the first
+ * line, followed by pairs of lines giving each mountpoint and its
+ * device, shortest mountpoint first.  Windows guests are not cached,
+ * since these tools need other inspection data to translate their
+ * paths, and neither are guests with encrypted devices, which need
+ * keys before they can be mounted.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <error.h>
+#include <libintl.h>
+
+#include "getprogname.h"
+
+#include "guestfs.h"
+#include "guestfs-utils.h"
+#include "options.h"
+
+#include "disk-id.h"
+#include "mount-cache.h"
+
+char *
+mount_cache_filename (const char *dir, struct drv *drvs)
+{
+  uint64_t h = HASH_INIT;
+  char *ret;
+
+  hash_string (&h, PACKAGE_VERSION);
+  if (hash_drives (&h, drvs) == -1) {
+    if (verbose)
+      fprintf (stderr, "%s: these disks cannot be cached\n", getprogname ());
+    return NULL;
+  }
+
+  if (asprintf (&ret, "%s/%016" PRIx64 ".mounts", dir, h) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  return ret;
+}
+
+char *
+mount_from_cache (const char *filename)
+{
+  CLEANUP_FCLOSE FILE *fp = NULL;
+  CLEANUP_FREE char *type = NULL;
+  CLEANUP_FREE char *mountpoint = NULL;
+  CLEANUP_FREE char *device = NULL;
+  size_t type_size = 0, mountpoint_size = 0, device_size = 0;
+  ssize_t len;
+  int r;
+
+  fp = fopen (filename, "r");
+  if (fp == NULL) {
+    if (errno != ENOENT)
+      perror (filename);
+    return NULL;
+  }
+
+  len = getline (&type, &type_size, fp);
+  if (len <= 1)
+    goto invalid;
+  type[len-1] = '\0';
+
+  while ((len = getline (&mountpoint, &mountpoint_size, fp)) != -1) {
+    mountpoint[len-1] = '\0';
+    len = getline (&device, &device_size, fp);
+    if (len <= 1)
+      goto invalid;
+    device[len-1] = '\0';
+
+    guestfs_push_error_handler (g, NULL, NULL);
+    r = guestfs_mount_ro (g, device, mountpoint);
+    guestfs_pop_error_handler (g);
+    if (r == -1) {
+      /* The guest must have changed in a way which the cache key
+       * did not catch.  Start again with inspection.
+       */
+      if (verbose)
+        fprintf (stderr, "%s: could not mount %s on %s from %s\n",
+                 getprogname (), device, mountpoint, filename);
+      guestfs_umount_all (g);
+      return NULL;
+    }
+  }
+
+  if (verbose)
+    fprintf (stderr, "%s: mounted filesystems from cache %s\n",
+             getprogname (), filename);
+  return strdup (type);
+
+ invalid:
+  if (verbose)
+    fprintf (stderr, "%s: ignoring invalid cache file %s\n",
+             getprogname (), filename);
+  guestfs_umount_all (g);
+  return NULL;
+}
+
+static int
+compare_mountpoint_len (const void *p1, const void *p2)
+{
+  const char *key1 = * (char * const *) p1;
+  const char *key2 = * (char * const *) p2;
+  const size_t len1 = strlen (key1), len2 = strlen (key2);
+
+  return len1 < len2 ? -1 : len1 > len2;
+}
+
+void
+mount_cache_save (const char *filename)
+{
+  CLEANUP_FREE_STRING_LIST char **roots = NULL;
+  CLEANUP_FREE_STRING_LIST char **mountpoints = NULL;
+  CLEANUP_FREE char *type = NULL;
+  CLEANUP_FREE char *tmppath = NULL;
+  const char *slash;
+  FILE *fp;
+  size_t i, n;
+  int fd, r;
+
+  /* inspect_mount has already checked that there is one root. */
+  roots = guestfs_inspect_get_roots (g);
+  if (roots == NULL || roots[0] == NULL || roots[1] != NULL)
+    return;
+  type = guestfs_inspect_get_type (g, roots[0]);
+  mountpoints = guestfs_inspect_get_mountpoints (g, roots[0]);
+  if (type == NULL || mountpoints == NULL || STREQ (type, "windows"))
+    return;
+
+  n = guestfs_int_count_strings (mountpoints) / 2;
+  for (i = 0; i < n; ++i) {
+    if (STRPREFIX (mountpoints[2*i+1], "/dev/mapper/") ||
+        strchr (mountpoints[2*i], '\n') != NULL)
+      return;
+  }
+  qsort (mountpoints, n, 2 * sizeof (char *), compare_mountpoint_len);
+
+  slash = strrchr (filename, '/');
+  if (asprintf (&tmppath, "%.*s/.tmpXXXXXX",
+                (int) (slash - filename), filename) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  fd = mkstemp (tmppath);
+  if (fd == -1) {
+    fprintf (stderr, _("%s: warning: cannot write to the cache: %s: %m\n"),
+             getprogname (), tmppath);
+    return;
+  }
+  fp = fdopen (fd, "w");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "fdopen: %s", tmppath);
+
+  fprintf (fp, "%s\n", type);
+  for (i = 0; i < n; ++i)
+    fprintf (fp, "%s\n%s\n", mountpoints[2*i], mountpoints[2*i+1]);
+
+  r = fflush (fp) == EOF || fsync (fd) == -1 ? -1 : 0;
+  if (fclose (fp) == EOF || r == -1 || rename (tmppath, filename) == -1) {
+    perror (filename);
+    unlink (tmppath);
+  }
+}
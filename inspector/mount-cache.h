@@ -0,0 +1,39 @@
+/* Cache the filesystems mounted by inspection
+ * Copyright (C) 2026 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GUESTFS_MOUNT_CACHE_H
+#define GUESTFS_MOUNT_CACHE_H
+
+struct drv;
+
+/* Return the name of the cache file for these drives, or NULL if
+ * they cannot be cached.
+ */
+extern char *mount_cache_filename (const char *dir, struct drv *drvs);
+
+/* Mount the filesystems listed in the cache file without inspecting
+ * the guest.  Returns the type of the operating system (eg. "linux"),
+ * or NULL if nothing was mounted and the caller should call
+ * inspect_mount () instead.
+ */
+extern char *mount_from_cache (const char *filename);
+
+/* After inspect_mount (), save the filesystems in the cache file. */
+extern void mount_cache_save (const char *filename);
+
+#endif /* GUESTFS_MOUNT_CACHE_H */
@@ -43,3 +43,17 @@ done
 # $VG virt-inspector \
 #   -a ../test-data/phony-guests/fedora-md1.img \
 #   -a ../test-data/phony-guests/fedora-md2.img
+
+# Test --cache: the first run inspects the guest and fills the cache,
+# the second run must print the same XML from the cache.
+f=../test-data/phony-guests/fedora.img
+rm -rf cache.tmp
+mkdir cache.tmp
+$VG virt-inspector --cache cache.tmp --format=raw -a "$f" > actual-cold.xml
+test "$(ls cache.tmp | wc -l)" -eq 1
+$VG virt-inspector -v --cache cache.tmp --format=raw -a "$f" \
+    > actual-warm.xml 2> cache.log
+grep "using cached inspection data" cache.log
+diff -u actual-cold.xml actual-warm.xml
+diff -ur $diff_ignore "$srcdir/expected-fedora.img.xml" actual-warm.xml
+rm -r cache.tmp cache.log actual-cold.xml actual-warm.xml
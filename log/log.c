@@ -43,6 +43,8 @@
 #include "options.h"
 #include "display-options.h"
 
+#include "mount-cache.h"
+
 /* Currently open libguestfs handle. */
 guestfs_h *g;
 
@@ -57,7 +59,10 @@ int in_virt_rescue = 0;
 
 #define JOURNAL_DIR "/var/log/journal"
 
+static const char *cache_dir = NULL;
+
 static int do_log (void);
+static int do_log_type (const char *type);
 static int do_log_journal (void);
 static int do_log_text_file (const char *filename);
 static int do_log_windows_evtx (void);
@@ -78,6 +83,7 @@ usage (int status)
               "  -a|--add image       Add image\n"
               "  --blocksize[=512|4096]\n"
               "                       Set sector size of the disk for -a option\n"
+              "  --cache dir          Cache the guest's mountpoints in dir\n"
               "  -c|--connect uri     Specify libvirt URI for -d option\n"
               "  -d|--domain guest    Add disks from libvirt guest\n"
               "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -108,6 +114,7 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
     { "blocksize", 2, 0, 0 },
+    { "cache", 1, 0, 0 },
     { "connect", 1, 0, 'c' },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -130,6 +137,8 @@ main (int argc, char *argv[])
   int r;
   int option_index;
   struct key_store *ks = NULL;
+  CLEANUP_FREE char *cache_file = NULL;
+  CLEANUP_FREE char *type = NULL;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -155,6 +164,8 @@ main (int argc, char *argv[])
         OPTION_blocksize;
       } else if (STREQ (long_options[option_index].name, "key")) {
         OPTION_key;
+      } else if (STREQ (long_options[option_index].name, "cache")) {
+        cache_dir = optarg;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -219,6 +230,12 @@ main (int argc, char *argv[])
     usage (EXIT_FAILURE);
   }
 
+  /* With --cache, the filesystems can be mounted without inspecting
+   * the guest if it was inspected before.
+   */
+  if (cache_dir && ks == NULL)
+    cache_file = mount_cache_filename (cache_dir, drvs);
+
   /* Add drives, inspect and mount.  Note that inspector is always true,
    * and there is no -m option.
    */
@@ -230,13 +247,21 @@ main (int argc, char *argv[])
   if (guestfs_launch (g) == -1)
     exit (EXIT_FAILURE);
 
-  inspect_mount ();
+  if (cache_file == NULL ||
+      (type = mount_from_cache (cache_file)) == NULL) {
+    inspect_mount ();
+    if (cache_file)
+      mount_cache_save (cache_file);
+  }
 
   /* Free up data structures, no longer needed after this point. */
   free_drives (drvs);
   free_key_store (ks);
 
-  r = do_log ();
+  /* If the filesystems were mounted from the cache, there is no
+   * inspection data, but the cache records the type of the guest.
+   */
+  r = type ? do_log_type (type) : do_log ();
 
   guestfs_close (g);
 
@@ -249,7 +274,6 @@ do_log (void)
   CLEANUP_FREE_STRING_LIST char **roots = NULL;
   char *root;
   CLEANUP_FREE char *type = NULL;
-  CLEANUP_FREE_STRING_LIST char **journal_files = NULL;
 
   /* Get root mountpoint.  fish/inspect.c guarantees the assertions
    * below.
@@ -275,6 +299,14 @@ do_log (void)
     return -1;
   }
 
+  return do_log_type (type);
+}
+
+static int
+do_log_type (const char *type)
+{
+  CLEANUP_FREE_STRING_LIST char **journal_files = NULL;
+
   /* systemd journal? */
   guestfs_push_error_handler (g, NULL, NULL);
   journal_files = guestfs_ls (g, JOURNAL_DIR);
@@ -0,0 +1,445 @@
+/* virt-ls
+ * Copyright (C) 2010-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The --index file holds the names and stats of every file in the
+ * guest, so that later listings of the same disks can be answered
+ * without launching the appliance.
+ *
+ * The file is read with mmap.  It contains a header, then one fixed
+ * size entry per file in the order of a depth first walk of the
+ * guest (so a directory is followed by everything under it), then for
+ * each entry the index of the entry after its subtree, then the path
+ * and symbolic link strings.  Numbers are in host byte order, so an
+ * index file is only valid on the host which wrote it.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <error.h>
+#include <libintl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "getprogname.h"
+
+#include "guestfs.h"
+#include "structs-cleanups.h"
+
+#include "options.h"
+#include "guestfs-utils.h"
+#include "visit.h"
+
+#include "disk-id.h"
+#include "virt-ls.h"
+
+#define INDEX_MAGIC "VLSIDX1"
+#define INDEX_BYTE_ORDER UINT64_C (0x0102030405060708)
+#define NO_LINK UINT64_MAX
+
+struct index_header {
+  char magic[8];                /* INDEX_MAGIC */
+  uint64_t byte_order;          /* INDEX_BYTE_ORDER */
+  uint64_t entry_size;          /* sizeof (struct index_entry) */
+  uint64_t nr_entries;
+  uint64_t strings_size;
+};
+
+struct index_entry {
+  uint64_t path;                /* Offset of the path in the strings. */
+  uint64_t link;                /* Offset of the link target, or NO_LINK. */
+  struct guestfs_statns stat;
+};
+
+struct index {
+  void *addr;
+  size_t size;
+  size_t nr_entries;
+  const struct index_entry *entries;
+  const uint64_t *ends;
+  const char *strings;
+};
+
+/* Return the name of the index file in 'dir' for these drives and
+ * mountpoints, or NULL if they cannot be indexed.  As with
+ * virt-inspector --cache, only local disk images added with -a can
+ * be indexed.
+ */
+char *
+index_filename (const char *dir, struct drv *drvs, struct mp *mps)
+{
+  uint64_t h = HASH_INIT;
+  struct mp *mp;
+  char *ret;
+
+  hash_string (&h, PACKAGE_VERSION);
+
+  if (hash_drives (&h, drvs) == -1)
+    return NULL;
+
+  /* The files seen depend on what is mounted where.  With no -m
+   * options, the guest is inspected and mounted.
+   */
+  for (mp = mps; mp != NULL; mp = mp->next) {
+    hash_string (&h, mp->device);
+    hash_string (&h, mp->mountpoint);
+    hash_string (&h, mp->options);
+    hash_string (&h, mp->fstype);
+  }
+
+  if (asprintf (&ret, "%s/%016" PRIx64 ".idx", dir, h) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  return ret;
+}
+
+struct builder {
+  FILE *fp;                     /* The index file. */
+  FILE *strings;                /* Temporary file for the strings. */
+  uint64_t strings_size;
+  uint64_t *ends;
+  size_t nr_entries, allocated;
+};
+
+static uint64_t
+add_string (struct builder *b, const char *str)
+{
+  const uint64_t ret = b->strings_size;
+  const size_t len = strlen (str) + 1;
+
+  if (fwrite (str, 1, len, b->strings) != len)
+    error (EXIT_FAILURE, errno, "fwrite");
+  b->strings_size += len;
+  return ret;
+}
+
+static size_t
+add_entry (struct builder *b, const char *path,
+           const struct guestfs_statns *stat, const char *link)
+{
+  struct index_entry entry;
+
+  memset (&entry, 0, sizeof entry);
+  entry.path = add_string (b, path);
+  entry.link = link ? add_string (b, link) : NO_LINK;
+  entry.stat = *stat;
+  if (fwrite (&entry, sizeof entry, 1, b->fp) != 1)
+    error (EXIT_FAILURE, errno, "fwrite");
+
+  if (b->nr_entries >= b->allocated) {
+    b->allocated = b->allocated == 0 ? 1024 : b->allocated * 2;
+    b->ends = realloc (b->ends, b->allocated * sizeof (uint64_t));
+    if (b->ends == NULL)
+      error (EXIT_FAILURE, errno, "realloc");
+  }
+  b->ends[b->nr_entries] = b->nr_entries + 1;
+  return b->nr_entries++;
+}
+
+/* Add the entries of one directory and everything under it.  This
+ * reads each directory in the same way as virt-ls -lR does.  Since
+ * guestfs_ls returns the names sorted, the entries come out in the
+ * order used by compare_paths below.
+ */
+static int
+build_dir (struct builder *b, const char *dir)
+{
+  struct dir d;
+  size_t i, n;
+  int r = 0;
+
+  if (read_dir (dir, &d) == -1)
+    return -1;
+
+  for (i = 0; i < d.len; ++i) {
+    CLEANUP_FREE char *path = guestfs_int_full_path (dir, d.names[i]);
+
+    if (!path)
+      error (EXIT_FAILURE, errno, "guestfs_int_full_path");
+
+    n = add_entry (b, path, &d.stats->val[i], d.links[i]);
+    if (guestfs_int_is_dir (d.stats->val[i].st_mode)) {
+      if (build_dir (b, path) == -1) {
+        r = -1;
+        break;
+      }
+      b->ends[n] = b->nr_entries;
+    }
+  }
+
+  free_dir (&d);
+  return r;
+}
+
+/* Walk the whole guest filesystem and write the index to 'filename'.
+ * The index is written to a temporary file in 'dir' first and then
+ * renamed, so a partial index is never seen.  Returns -1 if the index
+ * could not be written, in which case the caller lists the guest
+ * normally.
+ */
+int
+index_build (const char *dir, const char *filename)
+{
+  CLEANUP_FREE_STATNS struct guestfs_statns *stat = NULL;
+  CLEANUP_FREE char *tmppath = NULL;
+  struct builder b = { 0 };
+  struct index_header header;
+  char buf[BUFSIZ];
+  size_t n;
+  int fd, r = -1;
+
+  if (asprintf (&tmppath, "%s/.tmpXXXXXX", dir) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+  fd = mkstemp (tmppath);
+  if (fd == -1) {
+    fprintf (stderr, _("%s: warning: cannot write the index: %s: %m\n"),
+             getprogname (), tmppath);
+    return -1;
+  }
+  b.fp = fdopen (fd, "w");
+  if (b.fp == NULL) {
+    fprintf (stderr, _("%s: warning: cannot write the index: %s: %m\n"),
+             getprogname (), tmppath);
+    close (fd);
+    unlink (tmppath);
+    return -1;
+  }
+  b.strings = tmpfile ();
+  if (b.strings == NULL)
+    error (EXIT_FAILURE, errno, "tmpfile");
+
+  /* The header is written last, when the sizes are known. */
+  memset (&header, 0, sizeof header);
+  if (fwrite (&header, sizeof header, 1, b.fp) != 1)
+    error (EXIT_FAILURE, errno, "fwrite");
+
+  stat = guestfs_lstatns (g, "/");
+  if (stat == NULL)
+    goto out;
+  add_entry (&b, "/", stat, NULL);
+  if (build_dir (&b, "/") == -1)
+    goto out;
+  b.ends[0] = b.nr_entries;
+
+  if (fwrite (b.ends, sizeof (uint64_t), b.nr_entries, b.fp) != b.nr_entries)
+    error (EXIT_FAILURE, errno, "fwrite");
+  rewind (b.strings);
+  while ((n = fread (buf, 1, sizeof buf, b.strings)) > 0) {
+    if (fwrite (buf, 1, n, b.fp) != n)
+      error (EXIT_FAILURE, errno, "fwrite");
+  }
+  if (ferror (b.strings))
+    error (EXIT_FAILURE, errno, "fread");
+
+  memcpy (header.magic, INDEX_MAGIC, sizeof header.magic);
+  header.byte_order = INDEX_BYTE_ORDER;
+  header.entry_size = sizeof (struct index_entry);
+  header.nr_entries = b.nr_entries;
+  header.strings_size = b.strings_size;
+  if (fseek (b.fp, 0, SEEK_SET) == -1 ||
+      fwrite (&header, sizeof header, 1, b.fp) != 1 ||
+      fflush (b.fp) == EOF || fsync (fd) == -1) {
+    perror (tmppath);
+    goto out;
+  }
+
+  if (rename (tmppath, filename) == -1) {
+    perror (filename);
+    goto out;
+  }
+
+  if (verbose)
+    fprintf (stderr, "%s: wrote %zu entries to index %s\n",
+             getprogname (), b.nr_entries, filename);
+  r = 0;
+
+ out:
+  if (r == -1)
+    unlink (tmppath);
+  fclose (b.fp);
+  fclose (b.strings);
+  free (b.ends);
+  return r;
+}
+
+/* Open an index file.  Returns NULL if there is no index, or if it
+ * was not written by this version of virt-ls on this host.
+ */
+struct index *
+index_open (const char *filename)
+{
+  struct index *idx;
+  struct index_header header;
+  struct stat statbuf;
+  uint64_t size;
+  size_t i;
+  int fd;
+
+  fd = open (filename, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOENT)
+      error (EXIT_FAILURE, errno, "open: %s", filename);
+    return NULL;
+  }
+  if (fstat (fd, &statbuf) == -1)
+    error (EXIT_FAILURE, errno, "fstat: %s", filename);
+  if (pread (fd, &header, sizeof header, 0) != sizeof header)
+    goto invalid;
+
+  if (memcmp (header.magic, INDEX_MAGIC, sizeof header.magic) != 0 ||
+      header.byte_order != INDEX_BYTE_ORDER ||
+      header.entry_size != sizeof (struct index_entry) ||
+      header.nr_entries == 0 ||
+      header.nr_entries > SIZE_MAX / (sizeof (struct index_entry) + 8) ||
+      header.strings_size == 0)
+    goto invalid;
+  size = sizeof header +
+    header.nr_entries * (sizeof (struct index_entry) + sizeof (uint64_t)) +
+    header.strings_size;
+  if (size != (uint64_t) statbuf.st_size)
+    goto invalid;
+
+  idx = malloc (sizeof *idx);
+  if (idx == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  idx->size = size;
+  idx->addr = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (idx->addr == MAP_FAILED)
+    error (EXIT_FAILURE, errno, "mmap: %s", filename);
+  close (fd);
+
+  idx->nr_entries = header.nr_entries;
+  idx->entries =
+    (const struct index_entry *) ((const char *) idx->addr + sizeof header);
+  idx->ends = (const uint64_t *) &idx->entries[idx->nr_entries];
+  idx->strings = (const char *) &idx->ends[idx->nr_entries];
+
+  /* Check the offsets once here, so that the accessors below can
+   * trust them.
+   */
+  if (idx->strings[header.strings_size - 1] != '\0')
+    goto invalid_mapped;
+  for (i = 0; i < idx->nr_entries; ++i) {
+    if (idx->entries[i].path >= header.strings_size ||
+        (idx->entries[i].link != NO_LINK &&
+         idx->entries[i].link >= header.strings_size) ||
+        idx->ends[i] <= i || idx->ends[i] > idx->nr_entries)
+      goto invalid_mapped;
+  }
+
+  if (verbose)
+    fprintf (stderr, "%s: using index %s\n", getprogname (), filename);
+  return idx;
+
+ invalid_mapped:
+  index_close (idx);
+  fd = -1;
+ invalid:
+  if (fd >= 0)
+    close (fd);
+  if (verbose)
+    fprintf (stderr, "%s: ignoring invalid index %s\n",
+             getprogname (), filename);
+  return NULL;
+}
+
+void
+index_close (struct index *idx)
+{
+  if (idx) {
+    munmap (idx->addr, idx->size);
+    free (idx);
+  }
+}
+
+/* Compare paths a component at a time, which is the order of the
+ * entries in the index: '/' sorts before any other character, so
+ * that a directory is followed by everything under it.
+ */
+static int
+compare_paths (const char *p1, const char *p2)
+{
+  int c1, c2;
+
+  while (*p1 && *p1 == *p2)
+    p1++, p2++;
+
+  c1 = *p1 == '/' ? 1 : *p1 ? (unsigned char) *p1 + 1 : 0;
+  c2 = *p2 == '/' ? 1 : *p2 ? (unsigned char) *p2 + 1 : 0;
+  return c1 - c2;
+}
+
+/* Find the entry for 'path', which must be absolute with no "." or
+ * ".." components or repeated slashes.  Returns -1 if not found.
+ */
+ssize_t
+index_lookup (const struct index *idx, const char *path)
+{
+  size_t lo = 0, hi = idx->nr_entries;
+
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    const int r = compare_paths (path, index_path (idx, mid));
+
+    if (r == 0)
+      return mid;
+    else if (r < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return -1;
+}
+
+/* The entries under entry 'i' are those from i+1 up to (but not
+ * including) index_end (idx, i).
+ */
+size_t
+index_end (const struct index *idx, size_t i)
+{
+  return idx->ends[i];
+}
+
+const char *
+index_path (const struct index *idx, size_t i)
+{
+  return &idx->strings[idx->entries[i].path];
+}
+
+const char *
+index_link (const struct index *idx, size_t i)
+{
+  if (idx->entries[i].link == NO_LINK)
+    return NULL;
+  return &idx->strings[idx->entries[i].link];
+}
+
+const struct guestfs_statns *
+index_stat (const struct index *idx, size_t i)
+{
+  return &idx->entries[i].stat;
+}
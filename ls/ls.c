@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
@@ -45,12 +46,16 @@
 #include "getprogname.h"
 
 #include "guestfs.h"
+#include "structs-cleanups.h"
 
 #include "options.h"
 #include "display-options.h"
 #include "guestfs-utils.h"
 #include "visit.h"
 
+#include "checksums.h"
+#include "virt-ls.h"
+
 /* Currently open libguestfs handle. */
 guestfs_h *g;
 
@@ -71,6 +76,7 @@ static int time_t_output = 0;
 static int time_relative = 0; /* 1 = seconds, 2 = days */
 static int enable_extra_stats = 0;
 static const char *checksum = NULL;
+static const char *index_dir = NULL;
 
 static time_t now;
 
@@ -79,6 +85,11 @@ static int do_ls_l (const char *dir);
 static int do_ls_R (const char *dir);
 static int do_ls_lR (const char *dir);
 
+static bool index_can_answer (const struct index *idx, char **dirs);
+static int index_ls (const struct index *idx, const char *dir);
+static int index_ls_R (const struct index *idx, const char *dir);
+static int index_ls_lR (const struct index *idx, const char *dir);
+
 static void output_start_line (void);
 static void output_end_line (void);
 static void output_int64 (int64_t);
@@ -115,6 +126,7 @@ usage (int status)
               "  --format[=raw|..]    Force disk format for -a option\n"
               "  --help               Display brief help\n"
               "  -h|--human-readable  Human-readable sizes in output\n"
+              "  --index dir          Keep an index of the guest files in dir\n"
               "  --key selector       Specify a LUKS key\n"
               "  --keys-from-stdin    Read passphrases from stdin\n"
               "  -l|--long            Long listing\n"
@@ -163,6 +175,7 @@ main (int argc, char *argv[])
     { "format", 2, 0, 0 },
     { "help", 0, 0, HELP_OPTION },
     { "human-readable", 0, 0, 'h' },
+    { "index", 1, 0, 0 },
     { "key", 1, 0, 0 },
     { "keys-from-stdin", 0, 0, 0 },
     { "long", 0, 0, 'l' },
@@ -197,6 +210,9 @@ main (int argc, char *argv[])
 #define MODE_LS_LR (MODE_LS_L|MODE_LS_R)
   int mode = 0;
   struct key_store *ks = NULL;
+  CLEANUP_FREE char *index_file = NULL;
+  struct index *idx = NULL;
+  bool build_index = false;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -228,6 +244,8 @@ main (int argc, char *argv[])
           checksum = optarg;
       } else if (STREQ (long_options[option_index].name, "csv")) {
         csv = 1;
+      } else if (STREQ (long_options[option_index].name, "index")) {
+        index_dir = optarg;
       } else if (STREQ (long_options[option_index].name, "extra-stat") ||
                  STREQ (long_options[option_index].name, "extra-stats")) {
         enable_extra_stats = 1;
@@ -353,6 +371,13 @@ main (int argc, char *argv[])
     error (EXIT_FAILURE, 0,
            _("used a flag which can only be combined with -lR mode\nFor more information, read the virt-ls(1) man page."));
 
+  /* The index holds the output of guestfs_ls, guestfs_find and the
+   * stats, but not the output of guestfs_ll or file checksums.
+   */
+  if (index_dir && (mode == MODE_LS_L || checksum))
+    error (EXIT_FAILURE, 0,
+           _("--index cannot be used with -l (without -R) or --checksum"));
+
   /* CSV && human is unsafe because spreadsheets fail to parse these
    * fields correctly.  (RHBZ#600977).
    */
@@ -371,19 +396,52 @@ main (int argc, char *argv[])
     usage (EXIT_FAILURE);
   }
 
-  /* Add drives, inspect and mount. */
-  add_drives (drvs);
+  /* If there is an index for exactly these disk images, answer from
+   * it without launching the appliance.  Otherwise the index is built
+   * after the guest has been mounted.
+   */
+  if (index_dir) {
+    if (ks != NULL) {
+      if (verbose)
+        fprintf (stderr, "%s: not using the index because --key was given\n",
+                 getprogname ());
+    } else
+      index_file = index_filename (index_dir, drvs, mps);
+
+    if (index_file) {
+      idx = index_open (index_file);
+      build_index = idx == NULL;
+      if (idx && !index_can_answer (idx, &argv[optind])) {
+        index_close (idx);
+        idx = NULL;
+      }
+    } else if (verbose)
+      fprintf (stderr, "%s: these disks cannot be indexed\n", getprogname ());
+  }
+
+  if (idx == NULL) {
+    /* Add drives, inspect and mount. */
+    add_drives (drvs);
 
-  if (key_store_requires_network (ks) && guestfs_set_network (g, 1) == -1)
-    exit (EXIT_FAILURE);
+    if (key_store_requires_network (ks) && guestfs_set_network (g, 1) == -1)
+      exit (EXIT_FAILURE);
 
-  if (guestfs_launch (g) == -1)
-    exit (EXIT_FAILURE);
+    if (guestfs_launch (g) == -1)
+      exit (EXIT_FAILURE);
 
-  if (mps != NULL)
-    mount_mps (mps);
-  else
-    inspect_mount ();
+    if (mps != NULL)
+      mount_mps (mps);
+    else
+      inspect_mount ();
+
+    if (build_index && index_build (index_dir, index_file) == 0) {
+      idx = index_open (index_file);
+      if (idx && !index_can_answer (idx, &argv[optind])) {
+        index_close (idx);
+        idx = NULL;
+      }
+    }
+  }
 
   /* Free up data structures, no longer needed after this point. */
   free_drives (drvs);
@@ -397,7 +455,7 @@ main (int argc, char *argv[])
 
     switch (mode) {
     case 0:                     /* no -l or -R option */
-      if (do_ls (dir) == -1)
+      if ((idx ? index_ls (idx, dir) : do_ls (dir)) == -1)
         errors++;
       break;
 
@@ -407,12 +465,12 @@ main (int argc, char *argv[])
       break;
 
     case MODE_LS_R:             /* virt-ls -R */
-      if (do_ls_R (dir) == -1)
+      if ((idx ? index_ls_R (idx, dir) : do_ls_R (dir)) == -1)
         errors++;
       break;
 
     case MODE_LS_LR:            /* virt-ls -lR */
-      if (do_ls_lR (dir) == -1)
+      if ((idx ? index_ls_lR (idx, dir) : do_ls_lR (dir)) == -1)
         errors++;
       break;
 
@@ -423,6 +481,7 @@ main (int argc, char *argv[])
     optind++;
   }
 
+  index_close (idx);
   guestfs_close (g);
 
   exit (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
@@ -471,29 +530,287 @@ do_ls_R (const char *dir)
   return 0;
 }
 
-static int show_file (const char *dir, const char *name, const struct guestfs_statns *stat, const struct guestfs_xattr_list *xattrs, void *unused);
+static void show_file (const char *path, const struct guestfs_statns *stat, const char *link);
+static int list_dir (const char *dir);
+
+/* With --checksum, the checksums of all regular files under the
+ * directory are fetched in a single call, see diff/checksums.c.
+ */
+static struct checksums csums;
 
 static int
 do_ls_lR (const char *dir)
 {
-  return visit (g, dir, show_file, NULL);
+  CLEANUP_FREE_STATNS struct guestfs_statns *stat = NULL;
+  CLEANUP_FREE char *path = NULL, *link = NULL;
+  int r = -1;
+
+  /* If the batch call fails (eg. because some file could not be
+   * read), fall back to checksumming each file separately.
+   */
+  if (checksum && read_checksums (&csums, g, checksum, dir) == -1 && verbose)
+    fprintf (stderr, "%s: checksumming files individually\n", getprogname ());
+
+  /* The directory itself is shown first. */
+  path = guestfs_int_full_path (dir, NULL);
+  if (!path)
+    error (EXIT_FAILURE, errno, "guestfs_int_full_path");
+  stat = guestfs_lstatns (g, path);
+  if (stat == NULL)
+    goto out;
+  if (guestfs_int_is_lnk (stat->st_mode))
+    link = guestfs_readlink (g, path);
+  show_file (path, stat, link);
+
+  r = list_dir (path);
+
+ out:
+  free_checksums (&csums);
+
+  return r;
+}
+
+/* Read the names, stats and symbolic link targets of the entries of
+ * one directory.  This takes a fixed number of calls to the daemon,
+ * however many entries the directory has: one each for the names and
+ * stats, and one to read all of the symbolic links.  The result must
+ * be freed with free_dir.
+ */
+int
+read_dir (const char *dir, struct dir *d)
+{
+  CLEANUP_FREE char **link_names = NULL;
+  char **links;
+  size_t i, j, nr_links = 0;
+
+  memset (d, 0, sizeof *d);
+
+  d->names = guestfs_ls (g, dir);
+  if (d->names == NULL)
+    return -1;
+  d->len = guestfs_int_count_strings (d->names);
+  if (d->len == 0)
+    return 0;
+
+  d->stats = guestfs_lstatnslist (g, dir, d->names);
+  if (d->stats == NULL)
+    goto error;
+  if (d->stats->len != d->len) {
+    fprintf (stderr, _("%s: error: unexpected number of stats for %s\n"),
+             getprogname (), dir);
+    goto error;
+  }
+
+  d->links = calloc (d->len, sizeof (char *));
+  link_names = malloc ((d->len + 1) * sizeof (char *));
+  if (d->links == NULL || link_names == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  for (i = 0; i < d->len; ++i) {
+    if (guestfs_int_is_lnk (d->stats->val[i].st_mode))
+      link_names[nr_links++] = d->names[i];
+  }
+  link_names[nr_links] = NULL;
+  if (nr_links == 0)
+    return 0;
+
+  links = guestfs_readlinklist (g, dir, link_names);
+  if (links == NULL)
+    goto error;
+  if (guestfs_int_count_strings (links) != nr_links) {
+    fprintf (stderr, _("%s: error: unexpected number of links for %s\n"),
+             getprogname (), dir);
+    guestfs_int_free_string_list (links);
+    goto error;
+  }
+
+  /* readlinklist returns "" for links which could not be read. */
+  for (i = j = 0; i < d->len; ++i) {
+    if (guestfs_int_is_lnk (d->stats->val[i].st_mode)) {
+      if (STRNEQ (links[j], ""))
+        d->links[i] = links[j];
+      else
+        free (links[j]);
+      j++;
+    }
+  }
+  free (links);
+
+  return 0;
+
+ error:
+  free_dir (d);
+  return -1;
+}
+
+void
+free_dir (struct dir *d)
+{
+  size_t i;
+
+  if (d->links) {
+    for (i = 0; i < d->len; ++i)
+      free (d->links[i]);
+    free (d->links);
+  }
+  if (d->stats)
+    guestfs_free_statns_list (d->stats);
+  guestfs_int_free_string_list (d->names);
+  memset (d, 0, sizeof *d);
+}
+
+/* List the entries of one directory, recursing into each
+ * subdirectory straight after it is shown.
+ */
+static int
+list_dir (const char *dir)
+{
+  struct dir d;
+  size_t i;
+  int r = 0;
+
+  if (read_dir (dir, &d) == -1)
+    return -1;
+
+  for (i = 0; i < d.len; ++i) {
+    CLEANUP_FREE char *path = guestfs_int_full_path (dir, d.names[i]);
+
+    if (!path)
+      error (EXIT_FAILURE, errno, "guestfs_int_full_path");
+
+    show_file (path, &d.stats->val[i], d.links[i]);
+
+    if (guestfs_int_is_dir (d.stats->val[i].st_mode)) {
+      if (list_dir (path) == -1) {
+        r = -1;
+        break;
+      }
+    }
+  }
+
+  free_dir (&d);
+  return r;
+}
+
+/* The following functions answer from the --index file, in the same
+ * order as the functions above.  Only directories named by their
+ * canonical path are looked up in the index.  Anything else (eg. a
+ * symbolic link to a directory) is listed using the appliance.
+ */
+static ssize_t
+index_lookup_dir (const struct index *idx, const char *dir)
+{
+  const size_t len = strlen (dir);
+  ssize_t i;
+
+  if (dir[0] != '/' ||
+      (len > 1 && dir[len-1] == '/') ||
+      strstr (dir, "//") != NULL ||
+      strstr (dir, "/./") != NULL || strstr (dir, "/../") != NULL ||
+      (len >= 2 && STREQ (&dir[len-2], "/.")) ||
+      (len >= 3 && STREQ (&dir[len-3], "/..")))
+    return -1;
+
+  i = index_lookup (idx, dir);
+  if (i == -1 || !guestfs_int_is_dir (index_stat (idx, i)->st_mode))
+    return -1;
+  return i;
+}
+
+static bool
+index_can_answer (const struct index *idx, char **dirs)
+{
+  for (; *dirs != NULL; ++dirs) {
+    if (index_lookup_dir (idx, *dirs) == -1)
+      return false;
+  }
+  return true;
+}
+
+static int
+index_ls (const struct index *idx, const char *dir)
+{
+  const size_t d = index_lookup_dir (idx, dir);
+  const size_t end = index_end (idx, d);
+  size_t i;
+
+  for (i = d + 1; i < end; i = index_end (idx, i))
+    printf ("%s\n", strrchr (index_path (idx, i), '/') + 1);
+
+  return 0;
+}
+
+static int
+compare_strings (const void *s1v, const void *s2v)
+{
+  const char *const *s1 = s1v;
+  const char *const *s2 = s2v;
+
+  return strcmp (*s1, *s2);
+}
+
+static int
+index_ls_R (const struct index *idx, const char *dir)
+{
+  const size_t d = index_lookup_dir (idx, dir);
+  const size_t end = index_end (idx, d);
+  const size_t skip = STREQ (dir, "/") ? 1 : strlen (dir) + 1;
+  CLEANUP_FREE const char **paths = NULL;
+  size_t i, n = 0;
+
+  /* guestfs_find returns the relative paths sorted with strcmp,
+   * which is not quite the order of the index.
+   */
+  paths = malloc ((end - d) * sizeof (char *));
+  if (paths == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  for (i = d + 1; i < end; ++i)
+    paths[n++] = index_path (idx, i) + skip;
+  qsort (paths, n, sizeof (char *), compare_strings);
+
+  for (i = 0; i < n; ++i)
+    puts (paths[i]);
+
+  return 0;
+}
+
+static void
+index_list_dir (const struct index *idx, size_t d)
+{
+  const size_t end = index_end (idx, d);
+  size_t i;
+
+  for (i = d + 1; i < end; i = index_end (idx, i)) {
+    show_file (index_path (idx, i), index_stat (idx, i), index_link (idx, i));
+
+    if (guestfs_int_is_dir (index_stat (idx, i)->st_mode))
+      index_list_dir (idx, i);
+  }
+}
+
+static int
+index_ls_lR (const struct index *idx, const char *dir)
+{
+  const size_t d = index_lookup_dir (idx, dir);
+
+  show_file (index_path (idx, d), index_stat (idx, d), index_link (idx, d));
+  index_list_dir (idx, d);
+
+  return 0;
 }
 
 /* This is the function which is called to display all files and
  * directories, and it's where the magic happens.  We are called with
- * full stat and extended attributes for each file, so there is no
- * penalty for displaying anything in those structures.  However if we
- * need other things (eg. checksum) we may have to go back to the
+ * full stat and the symbolic link target for each file, so there is
+ * no penalty for displaying anything in those structures.  However if
+ * we need other things (eg. checksum) we may have to go back to the
  * appliance and then there can be a very large penalty.
  */
-static int
-show_file (const char *dir, const char *name,
-           const struct guestfs_statns *stat,
-           const struct guestfs_xattr_list *xattrs,
-           void *unused)
+static void
+show_file (const char *path, const struct guestfs_statns *stat,
+           const char *link)
 {
   const char *filetype;
-  CLEANUP_FREE char *path = NULL, *csum = NULL, *link = NULL;
+  CLEANUP_FREE char *csum = NULL;
 
   /* Display the basic fields. */
   output_start_line ();
@@ -544,13 +861,9 @@ show_file (const char *dir, const char *name,
     output_xattrs (xattrs);
   */
 
-  path = guestfs_int_full_path (dir, name);
-  if (!path)
-    error (EXIT_FAILURE, errno, "guestfs_int_full_path");
-
   if (checksum) {
     if (guestfs_int_is_reg (stat->st_mode)) {
-      csum = guestfs_checksum (g, checksum, path);
+      csum = get_checksum (&csums, path);
       if (!csum)
         exit (EXIT_FAILURE);
 
@@ -561,15 +874,11 @@ show_file (const char *dir, const char *name,
 
   output_string (path);
 
-  if (guestfs_int_is_lnk (stat->st_mode))
-    /* XXX Fix this for NTFS. */
-    link = guestfs_readlink (g, path);
+  /* XXX Fix this for NTFS. */
   if (link)
     output_string_link (link);
 
   output_end_line ();
-
-  return 0;
 }
 
 /* Output functions.
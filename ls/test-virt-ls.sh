@@ -58,3 +58,32 @@ fi
 # Try the -l and -R options.   XXX Should check the output.
 $VG virt-ls -l ../test-data/phony-guests/fedora.img /
 $VG virt-ls -R ../test-data/phony-guests/fedora.img /
+
+# Try the --index option.  The first run builds the index.  The
+# later runs must answer from it (which virt-ls -v reports), in each
+# listing mode, and print the same as a run without the index.
+index=test-virt-ls.index
+rm -rf $index
+mkdir $index
+first=yes
+for opts in -lR -lR "" -R; do
+    expected="$($VG virt-ls $opts --format=raw -a ../test-data/phony-guests/fedora.img /boot)"
+    output="$($VG virt-ls -v $opts --index $index --format=raw -a ../test-data/phony-guests/fedora.img /boot 2>test-virt-ls.log)"
+    if [ "$output" != "$expected" ]; then
+        echo "$0: error: unexpected output from virt-ls $opts --index"
+        echo "output: ------------------------------------------"
+        echo "$output"
+        echo "expected: ----------------------------------------"
+        echo "$expected"
+        echo "--------------------------------------------------"
+        exit 1
+    fi
+    if [ $first = yes ]; then
+        grep "virt-ls: wrote .* entries to index" test-virt-ls.log
+        first=no
+    elif ! grep "virt-ls: using index" test-virt-ls.log; then
+        echo "$0: error: virt-ls $opts --index did not use the index"
+        exit 1
+    fi
+done
+rm -r $index test-virt-ls.log
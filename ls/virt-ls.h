@@ -0,0 +1,49 @@
+/* virt-ls
+ * Copyright (C) 2010-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GUESTFS_VIRT_LS_H_
+#define GUESTFS_VIRT_LS_H_
+
+#include "guestfs.h"
+
+struct drv;
+struct mp;
+
+/* ls.c */
+struct dir {
+  size_t len;                   /* Number of entries. */
+  char **names;
+  struct guestfs_statns_list *stats;
+  char **links;                 /* Link target of each entry, or NULL. */
+};
+extern int read_dir (const char *dir, struct dir *d);
+extern void free_dir (struct dir *d);
+
+/* index.c */
+struct index;
+extern char *index_filename (const char *dir, struct drv *drvs, struct mp *mps);
+extern int index_build (const char *dir, const char *filename);
+extern struct index *index_open (const char *filename);
+extern void index_close (struct index *idx);
+extern ssize_t index_lookup (const struct index *idx, const char *path);
+extern size_t index_end (const struct index *idx, size_t i);
+extern const char *index_path (const struct index *idx, size_t i);
+extern const char *index_link (const struct index *idx, size_t i);
+extern const struct guestfs_statns *index_stat (const struct index *idx, size_t i);
+
+#endif /* GUESTFS_VIRT_LS_H_ */
@@ -38,8 +38,9 @@ type cmdline = {
 
 and mode_t =
 | Mode_copying of
-    string * check_t * bool * string option * string option * string option
-| Mode_in_place
+    string * check_t * bool * string option * string option * string option *
+    int option * bool
+| Mode_in_place of string list * bool * int * (string * bool * int64) option
 and check_t = [`Ignore|`Continue|`Warn|`Fail]
 
 let parse_cmdline () =
@@ -55,24 +56,42 @@ let parse_cmdline () =
       error (f_"--check-tmpdir: unknown argument ‘%s’") str
   in
 
+  let cluster_size = ref "" in
   let compress = ref false in
+  let compression_type = ref "" in
   let convert = ref "" in
+  let convert_threads = ref 0 in
+  let dryrun = ref false in
+  let force = ref false in
   let format = ref "" in
   let ignores = ref [] in
   let in_place = ref false in
+  let jobs = ref 1 in
   let option = ref "" in
+  let out_of_order = ref false in
+  let state_dir = ref "" in
   let tmp = ref "" in
+  let trim_threshold = ref 0 in
   let zeroes = ref [] in
 
   let argspec = [
     [ L"check-tmpdir" ], Getopt.String ("ignore|...", set_check_tmpdir),  s_"Check there is enough space in $TMPDIR";
+    [ L"cluster-size" ], Getopt.Set_string (s_"size", cluster_size), s_"Set cluster size of output disk";
     [ L"compress" ], Getopt.Set compress,         s_"Compressed output format";
+    [ L"compression-type" ], Getopt.Set_string ("zlib|zstd", compression_type), s_"Set compression type of output disk";
     [ L"convert" ], Getopt.Set_string (s_"format", convert),    s_"Format of output disk (default: same as input)";
+    [ L"convert-threads" ], Getopt.Set_int (s_"N", convert_threads), s_"Number of parallel qemu-img convert requests";
+    [ S 'n'; L"dryrun"; L"dry-run" ], Getopt.Set dryrun, s_"Report reclaimable space only (with --in-place)";
+    [ L"force" ],   Getopt.Set force,             s_"Trim filesystems even if unchanged (with --state-dir)";
     [ L"format" ],  Getopt.Set_string (s_"format", format),     s_"Format of input disk";
     [ L"ignore" ],  Getopt.String (s_"fs", add ignores),  s_"Ignore filesystem";
     [ L"in-place"; L"inplace" ], Getopt.Set in_place,         s_"Modify the disk image in-place";
+    [ S 'j'; L"jobs" ], Getopt.Set_int (s_"N", jobs), s_"Sparsify up to N disks in parallel (with --in-place)";
     [ S 'o' ],        Getopt.Set_string (s_"option", option),     s_"Add qemu-img options";
+    [ S 'W'; L"out-of-order" ], Getopt.Set out_of_order, s_"Allow out-of-order writes to output disk";
+    [ L"state-dir" ], Getopt.Set_string (s_"dir", state_dir), s_"Remember trimmed filesystems in dir (with --in-place)";
     [ L"tmp" ],     Getopt.Set_string (s_"block|dir|prebuilt:file", tmp),        s_"Set temporary block device, directory or prebuilt file";
+    [ L"trim-threshold" ], Getopt.Set_int (s_"MB", trim_threshold), s_"Skip filesystems whose free space grew less than this (with --state-dir)";
     [ L"zero" ],    Getopt.String (s_"fs", add zeroes),   s_"Zero filesystem";
   ] in
   let disks = ref [] in
@@ -83,7 +102,7 @@ let parse_cmdline () =
 
  virt-sparsify [--options] indisk outdisk
 
- virt-sparsify [--options] --in-place disk
+ virt-sparsify [--options] --in-place disk [disk ...]
 
 A short summary of the options is given below.  For detailed help please
 read the man page virt-sparsify(1).
@@ -95,14 +114,25 @@ read the man page virt-sparsify(1).
 
   (* Dereference the rest of the args. *)
   let check_tmpdir = !check_tmpdir in
+  let cluster_size = match !cluster_size with "" -> None | str -> Some str in
   let compress = !compress in
+  let compression_type =
+    match !compression_type with "" -> None | str -> Some str in
   let convert = match !convert with "" -> None | str -> Some str in
+  let convert_threads =
+    match !convert_threads with 0 -> None | n -> Some n in
   let disks = List.rev !disks in
+  let dryrun = !dryrun in
+  let force = !force in
   let format = match !format with "" -> None | str -> Some str in
   let ignores = List.rev !ignores in
   let in_place = !in_place in
+  let jobs = !jobs in
   let option = match !option with "" -> None | str -> Some str in
+  let out_of_order = !out_of_order in
+  let state_dir = match !state_dir with "" -> None | str -> Some str in
   let tmp = match !tmp with "" -> None | str -> Some str in
+  let trim_threshold = !trim_threshold in
   let zeroes = List.rev !zeroes in
 
   (* No arguments and machine-readable mode?  Print out some facts
@@ -115,7 +145,11 @@ read the man page virt-sparsify(1).
     pr "zero\n";
     pr "check-tmpdir\n";
     pr "in-place\n";
+    pr "in-place-dry-run\n";
+    pr "in-place-jobs\n";
+    pr "in-place-state-dir\n";
     pr "tmp-option\n";
+    pr "convert-options\n";
     let g = open_guestfs () in
     g#add_drive "/dev/null";
     g#launch ();
@@ -151,14 +185,88 @@ read the man page virt-sparsify(1).
                   it must be a regular file")
               outdisk;
 
+      if dryrun then
+        error (f_"the --dry-run option can only be used with --in-place");
+
+      if jobs <> 1 then
+        error (f_"the --jobs option can only be used with --in-place");
+
+      if state_dir <> None then
+        error (f_"the --state-dir option can only be used with --in-place");
+
+      (match convert_threads with
+       | Some n when n < 1 || n > 16 ->
+          error (f_"--convert-threads parameter must be between 1 and 16")
+       | _ -> ());
+
+      if compress && out_of_order then
+        error (f_"you cannot use --compress and -W options together");
+
+      (* --cluster-size and --compression-type are just shorthands
+       * for the equivalent qemu-img -o options.
+       *)
+      let option =
+        let opts =
+          (match cluster_size with
+           | None -> []
+           | Some size -> ["cluster_size=" ^ size]) @
+          (match compression_type with
+           | None -> []
+           | Some typ -> ["compression_type=" ^ typ]) @
+          (match option with
+           | None -> []
+           | Some option -> [option]) in
+        match opts with
+        | [] -> None
+        | opts -> Some (String.concat "," opts) in
+
       indisk,
-      Mode_copying (outdisk, check_tmpdir, compress, convert, option, tmp)
+      Mode_copying (outdisk, check_tmpdir, compress, convert, option, tmp,
+                    convert_threads, out_of_order)
     )
     else (                      (* --in-place checks *)
       let indisk =
         match disks with
-        | [indisk] -> indisk
-        | _ -> error "usage: %s --in-place [--options] indisk" prog in
+        | indisk :: _ -> indisk
+        | [] -> error "usage: %s --in-place [--options] disk [disk ...]" prog in
+
+      if jobs < 1 then
+        error (f_"--jobs parameter must be at least 1");
+
+      (* Two appliances writing to the same disk at the same time
+       * would corrupt it, so reject a disk which was given twice,
+       * even under a different name (a symlink or a hard link).
+       *)
+      let rec check_duplicates = function
+        | [] -> ()
+        | (id, disk) :: rest ->
+           (match List.assoc_opt id rest with
+            | Some disk' ->
+               error (f_"‘%s’ and ‘%s’ are the same disk") disk disk'
+            | None -> check_duplicates rest) in
+      check_duplicates (
+        List.filter_map (
+          fun disk ->
+            try
+              let st = Unix.stat disk in
+              Some ((st.Unix.st_dev, st.Unix.st_ino), disk)
+            with Unix.Unix_error _ -> None
+        ) disks
+      );
+
+      if trim_threshold < 0 then
+        error (f_"--trim-threshold parameter must not be negative");
+
+      let state =
+        match state_dir with
+        | None ->
+           if force || trim_threshold <> 0 then
+             error (f_"the --force and --trim-threshold options \
+                       require --state-dir");
+           None
+        | Some dir ->
+           let threshold = Int64.of_int trim_threshold *^ 1048576L in
+           Some (dir, force, threshold) in
 
       if check_tmpdir <> `Warn then
         error (f_"you cannot use --in-place and --check-tmpdir \
@@ -173,10 +281,22 @@ read the man page virt-sparsify(1).
       if option <> None then
         error (f_"you cannot use --in-place and -o options together");
 
+      if cluster_size <> None then
+        error (f_"you cannot use --in-place and --cluster-size \
+                  options together");
+
+      if compression_type <> None then
+        error (f_"you cannot use --in-place and --compression-type \
+                  options together");
+
+      if convert_threads <> None || out_of_order then
+        error (f_"you cannot use --in-place and --convert-threads \
+                  or -W options together");
+
       if tmp <> None then
         error (f_"you cannot use --in-place and --tmp options together");
 
-      indisk, Mode_in_place
+      indisk, Mode_in_place (disks, dryrun, jobs, state)
     ) in
 
   { indisk = indisk;
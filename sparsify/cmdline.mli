@@ -29,8 +29,9 @@ type cmdline = {
 
 and mode_t =
 | Mode_copying of
-    string * check_t * bool * string option * string option * string option
-| Mode_in_place
+    string * check_t * bool * string option * string option * string option *
+    int option * bool
+| Mode_in_place of string list * bool * int * (string * bool * int64) option
 and check_t = [`Ignore|`Continue|`Warn|`Fail]
 
 val parse_cmdline : unit -> cmdline
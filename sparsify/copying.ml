@@ -37,7 +37,7 @@ type tmp_place =
 | Directory of string | Block_device of string | Prebuilt_file of string
 
 let run indisk outdisk check_tmpdir compress convert
-    format ignores option tmp_param zeroes ks =
+    format ignores option tmp_param zeroes convert_threads out_of_order ks =
 
   (* Once we have got past argument parsing and start to create
    * temporary files (including the potentially massive overlay file), we
@@ -332,15 +332,21 @@ You can ignore this warning or change it to a hard failure using the
   message ("Copy to destination and make sparse");
 
   let cmd =
-    sprintf "qemu-img convert -f qcow2 -O %s%s%s %s %s"
+    sprintf "qemu-img convert -f qcow2 -O %s%s%s%s%s %s %s"
       (quote output_format)
       (if compress then " -c" else "")
       (match option with
       | None -> ""
       | Some option -> " -o " ^ quote option)
+      (match convert_threads with
+      | None -> ""
+      | Some n -> sprintf " -m %d" n)
+      (if out_of_order then " -W" else "")
       (quote overlaydisk) (quote (qemu_input_filename outdisk)) in
+  let start_t = gettimeofday () in
   if shell_command cmd <> 0 then
     error (f_"external command failed: %s") cmd;
+  debug "qemu-img convert took %.1f seconds" (gettimeofday () -. start_t);
 
   (* Finished. *)
   message (f_"Sparsify operation completed with no errors.");
@@ -30,7 +30,12 @@ open Cmdline
 
 module G = Guestfs
 
-let run disk format ignores zeroes ks =
+let run ?(progress = true) disk format ignores zeroes dryrun state ks =
+  (* Record how much of the disk image is allocated on the host, so
+   * we can report how much was really deallocated at the end.
+   *)
+  let allocated_before = if dryrun then None else allocated_size disk in
+
   (* Connect to libguestfs. *)
   let g = open_guestfs () in
 
@@ -52,9 +57,12 @@ let run disk format ignores zeroes ks =
     | Some _ -> format
     | None -> Some (g#disk_format disk) in
 
-  g#add_drive ?format ~discard:"enable" disk;
+  if dryrun then
+    g#add_drive ?format ~readonly:true disk
+  else
+    g#add_drive ?format ~discard:"enable" disk;
 
-  if not (quiet ()) then (
+  if progress && not (quiet ()) then (
     let machine_readable = machine_readable () <> None in
     Progress.set_up_progress_bar ~machine_readable g
   );
@@ -64,7 +72,7 @@ let run disk format ignores zeroes ks =
   (* If discard is not supported in the appliance, we must return exit
    * code 3.  See the man page.
    *)
-  if not (g#feature_available [|"fstrim"|]) then
+  if not dryrun && not (g#feature_available [|"fstrim"|]) then
     error ~exit_code:3 (f_"discard/trim is not supported");
 
   (* Decrypt the disks. *)
@@ -84,34 +92,116 @@ let run disk format ignores zeroes ks =
 
   let is_read_only_lv = is_read_only_lv g in
 
+  (* If --state-dir was used, load the state for this disk. *)
+  let state, force, threshold =
+    match state with
+    | None -> None, false, 0L
+    | Some (directory, force, threshold) ->
+       Some (State.create ~directory disk), force, threshold in
+
+  (* Space which we expect to be able to reclaim, summed over all
+   * filesystems, swap partitions and volume groups.
+   *)
+  let reclaimable = ref 0L in
+  let add_reclaimable what bytes =
+    info (f_"%s: %s may be reclaimed") what (human_size bytes);
+    reclaimable := !reclaimable +^ bytes
+  in
+
   let tasks =
     List.map (
       fun fs () ->
         if not (is_ignored fs) && not (is_read_only_lv fs) then (
           if List.mem fs zeroes then (
-            message (f_"Zeroing %s") fs;
+            add_reclaimable fs (g#blockdev_getsize64 fs);
+
+            if not dryrun then (
+              message (f_"Zeroing %s") fs;
 
-            if not (g#blkdiscardzeroes fs) then
-              g#zero_device fs;
-            g#blkdiscard fs
+              if not (g#blkdiscardzeroes fs) then
+                g#zero_device fs;
+              g#blkdiscard fs
+            )
           ) else (
             let mounted =
-              try g#mount_options "discard" fs "/"; true
+              try
+                if dryrun then g#mount_ro fs "/"
+                else g#mount_options "discard" fs "/";
+                true
               with _ -> false in
 
             if mounted then (
-              message (f_"Trimming %s") fs;
-
-              try g#fstrim "/"
-              with G.Error msg as exn ->
-                if g#last_errno () = G.Errno.errno_ENOTSUP then (
-                  let vfs_type = try g#vfs_type fs with _ -> "unknown" in
-                  warning (f_"fstrim operation is not supported on %s (%s).  \
-                              Suppress this warning using '--ignore %s', \
-                              or use copying mode instead.")
-                          fs vfs_type fs
-                )
-                else raise exn
+              let free =
+                try Some (free_bytes g "/")
+                with G.Error msg -> debug "statvfs: %s: %s" fs msg; None in
+
+              (* Filesystems are identified in the state file by UUID,
+               * since device names may change between runs.
+               *)
+              let state =
+                match state with
+                | None -> None
+                | Some state ->
+                   let id =
+                     match (try g#vfs_uuid fs with G.Error _ -> "") with
+                     | "" -> fs
+                     | uuid -> uuid in
+                   Some (state, id) in
+              let last_trim =
+                match state with
+                | None -> None
+                | Some (state, id) -> State.find state id in
+
+              (* Free space in the filesystem is an upper bound on
+               * what fstrim will be able to discard.  If it was trimmed
+               * before, only the growth in free space since then is
+               * likely to be reclaimable.
+               *)
+              let skip =
+                match free, last_trim with
+                | None, _ -> false
+                | Some free, None ->
+                   add_reclaimable fs free;
+                   false
+                | Some free, Some (last_free, last_time) ->
+                   let growth = free -^ last_free in
+                   if not force && growth <= threshold then (
+                     info (f_"Skipping %s, free space has not grown by more \
+                              than %s since it was last trimmed on %s")
+                          fs (human_size threshold) (string_of_time last_time);
+                     (* Measure growth from the lowest free space seen
+                      * since the last trim, so that space which was
+                      * written and then freed again is trimmed later.
+                      *)
+                     (match state with
+                      | Some (state, id) when free < last_free ->
+                         State.set ~time:last_time state id free
+                      | _ -> ());
+                     true
+                   )
+                   else (
+                     add_reclaimable fs (max 0L growth);
+                     false
+                   ) in
+
+              if not dryrun && not skip then (
+                message (f_"Trimming %s") fs;
+
+                try
+                  g#fstrim "/";
+                  (match state, free with
+                   | Some (state, id), Some free -> State.set state id free
+                   | _ -> ())
+                with G.Error msg as exn ->
+                  if g#last_errno () = G.Errno.errno_ENOTSUP then (
+                    let vfs_type = try g#vfs_type fs with _ -> "unknown" in
+                    warning (f_"fstrim operation is not supported on %s (%s).  \
+                                Suppress this warning using '--ignore %s', \
+                                or use copying mode instead.")
+                            fs vfs_type fs
+                  )
+                  else raise exn
+              )
             ) else (
               let is_linux_x86_swap =
                 (* Look for the signature for Linux swap on i386.
@@ -124,17 +214,21 @@ let run disk format ignores zeroes ks =
                 with _ -> false in
 
               if is_linux_x86_swap then (
-                message (f_"Clearing Linux swap on %s") fs;
+                add_reclaimable fs (g#blockdev_getsize64 fs -^ 4096L);
 
-                (* Don't use mkswap.  Just preserve the header containing
-                 * the label, UUID and swap format version (libguestfs
-                 * mkswap may differ from guest's own).
-                 *)
-                let header = g#pread_device fs 4096 0L in
-                g#blkdiscard fs;
-                if g#pwrite_device fs header 0L <> 4096 then
-                  error (f_"pwrite: short write restoring \
-                            swap partition header")
+                if not dryrun then (
+                  message (f_"Clearing Linux swap on %s") fs;
+
+                  (* Don't use mkswap.  Just preserve the header containing
+                   * the label, UUID and swap format version (libguestfs
+                   * mkswap may differ from guest's own).
+                   *)
+                  let header = g#pread_device fs 4096 0L in
+                  g#blkdiscard fs;
+                  if g#pwrite_device fs header 0L <> 4096 then
+                    error (f_"pwrite: short write restoring \
+                              swap partition header")
+                )
               )
             )
           );
@@ -144,27 +238,32 @@ let run disk format ignores zeroes ks =
     ) filesystems in
 
   (* Discard unused space in volume groups. *)
-  let vgs = g#vgs () in
+  let vgs = g#vgs_full () in
   let vgs = Array.to_list vgs in
+  let vgs = List.map (fun { G.vg_name; vg_free } -> vg_name, vg_free) vgs in
   let vgs = List.sort compare vgs in
 
   let tasks = tasks @
     List.map (
-      fun vg () ->
-        if not (List.mem vg ignores) then (
-          let lvname = String.random8 () in
-          let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
+      fun (vg, vg_free) () ->
+        if not (List.mem vg ignores) && vg_free > 0L then (
+          add_reclaimable vg vg_free;
 
-          let created =
-            try g#lvcreate_free lvname vg 100; true
-            with _ -> false in
+          if not dryrun then (
+            let lvname = String.random8 () in
+            let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
 
-          if created then (
-            message (f_"Discard space in volgroup %s") vg;
+            let created =
+              try g#lvcreate_free lvname vg 100; true
+              with _ -> false in
+
+            if created then (
+              message (f_"Discard space in volgroup %s") vg;
 
-            g#blkdiscard lvdev;
-            g#sync ();
-            g#lvremove lvdev
+              g#blkdiscard lvdev;
+              g#sync ();
+              g#lvremove lvdev
+            )
           )
         )
     ) vgs in
@@ -181,11 +280,145 @@ let run disk format ignores zeroes ks =
   g#shutdown ();
   g#close ();
 
+  (* Save the state even if the user quit, since the filesystems
+   * which were trimmed are recorded correctly.
+   *)
+  (match state with
+   | Some state when not dryrun -> State.save state
+   | _ -> ());
+
   if not !quit then (
     (* Finished. *)
-    message (f_"Sparsify in-place operation completed with no errors")
+    info (f_"Total space which may be reclaimed: %s")
+         (human_size !reclaimable);
+
+    if dryrun then (
+      message (f_"Sparsify in-place dry run completed with no errors");
+      !reclaimable, None
+    )
+    else (
+      (* Compare the host allocation before and after.  This is the
+       * space that was actually deallocated, which may be less than
+       * the estimate above if the host filesystem or the qcow2 layer
+       * could not punch holes for everything that was discarded.
+       *)
+      let deallocated =
+        match allocated_before, allocated_size disk with
+        | Some before, Some after ->
+           let freed = max 0L (before -^ after) in
+           info (f_"Deallocated %s on the host (allocation %s -> %s)")
+                (human_size freed) (human_size before) (human_size after);
+           Some freed
+        | _ -> None in
+      message (f_"Sparsify in-place operation completed with no errors");
+      !reclaimable, deallocated
+    )
   )
   else (
     (* User quit. *)
     error (f_"quit (^C) at user request")
   )
+
+(* Sparsify several disk images, running up to [jobs] copies of
+ * [run] in parallel.  Each disk is handled in a separate subprocess
+ * with its own appliance so that a failure on one disk does not
+ * affect the others.  The subprocess sends its result back to us
+ * over a pipe, and at the end we print a summary for all the disks.
+ *)
+let run_many disks format ignores zeroes dryrun jobs state ks =
+  let start disk =
+    let rfd, wfd = pipe ~cloexec:true () in
+    flush_all ();
+    let pid = fork () in
+    if pid = 0 then ( (* child *)
+      close rfd;
+      (* The child must not run the at_exit handlers inherited from
+       * the parent, which belong to the parent process.  [error]
+       * calls [exit], and the most recently registered handler runs
+       * first, so this stops there.  The exit code passed to [exit]
+       * is not available here, so report it as a plain failure.
+       *)
+      at_exit (fun () -> flush_all (); _exit 1);
+      let code =
+        try
+          let reclaimable, deallocated =
+            run ~progress:false disk format ignores zeroes dryrun state ks in
+          let chan = out_channel_of_descr wfd in
+          fprintf chan "%Ld %Ld\n" reclaimable
+                  (match deallocated with Some n -> n | None -> -1L);
+          close_out chan;
+          0
+        with exn ->
+          eprintf "%s: %s: %s\n%!" prog disk (Printexc.to_string exn);
+          1 in
+      flush_all ();
+      _exit code
+    );
+    close wfd;
+    pid, (disk, rfd)
+  in
+
+  let read_result rfd =
+    let chan = in_channel_of_descr rfd in
+    let r =
+      try Scanf.sscanf (input_line chan) "%Ld %Ld" (fun r d -> Some (r, d))
+      with End_of_file | Scanf.Scan_failure _ | Failure _ -> None in
+    close_in chan;
+    r
+  in
+
+  let pending = ref disks and running = ref [] and results = ref [] in
+  while !pending <> [] || !running <> [] do
+    (* Start more subprocesses if there are free slots. *)
+    while !pending <> [] && List.length !running < jobs do
+      let disk = List.hd !pending in
+      pending := List.tl !pending;
+      List.push_front (start disk) running
+    done;
+
+    let pid, status = wait () in
+    match List.assoc_opt pid !running with
+    | None -> ()
+    | Some (disk, rfd) ->
+       running := List.remove_assoc pid !running;
+       let result =
+         match status, read_result rfd with
+         | WEXITED 0, Some r -> Ok r
+         | WEXITED 0, None -> Error (s_"could not read the result")
+         | WEXITED i, _ -> Error (sprintf (f_"failed (code %d)") i)
+         | (WSIGNALED i | WSTOPPED i), _ ->
+            Error (sprintf (f_"killed by signal (%d)") i) in
+       List.push_front (disk, result) results
+  done;
+
+  (* Print the summary in the same order as the disks were given. *)
+  let results = List.map (fun disk -> disk, List.assoc disk !results) disks in
+  let failed = ref 0 and total_reclaimable = ref 0L
+  and total_deallocated = ref 0L in
+  message (f_"Summary");
+  List.iter (
+    function
+    | disk, Ok (reclaimable, deallocated) ->
+       total_reclaimable := !total_reclaimable +^ reclaimable;
+       if deallocated >= 0L then (
+         total_deallocated := !total_deallocated +^ deallocated;
+         printf (f_"%s: reclaimable %s, deallocated %s\n")
+                disk (human_size reclaimable) (human_size deallocated)
+       )
+       else
+         printf (f_"%s: reclaimable %s\n") disk (human_size reclaimable)
+    | disk, Error msg ->
+       incr failed;
+       printf "%s: %s\n" disk msg
+  ) results;
+  if dryrun then
+    printf (f_"Total: %d disks, %d failed, reclaimable %s\n")
+           (List.length disks) !failed (human_size !total_reclaimable)
+  else
+    printf (f_"Total: %d disks, %d failed, reclaimable %s, deallocated %s\n")
+           (List.length disks) !failed (human_size !total_reclaimable)
+           (human_size !total_deallocated);
+  flush stdout;
+
+  if !failed > 0 then
+    error (f_"sparsify failed on %d of %d disks") !failed (List.length disks)
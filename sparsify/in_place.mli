@@ -18,4 +18,16 @@
 
 (** This is the virt-sparsify --in-place mode. *)
 
-val run : string -> string option -> string list -> string list -> Tools_utils.key_store -> unit
+val run : ?progress:bool -> string -> string option -> string list -> string list -> bool -> (string * bool * int64) option -> Tools_utils.key_store -> int64 * int64 option
+(** Sparsify a single disk in place.  Returns the estimated
+    reclaimable space and the space actually deallocated on the host
+    (if it could be measured).
+
+    If the state parameter is [Some (dir, force, threshold)] then
+    filesystems whose free space has grown by no more than [threshold]
+    bytes since they were last trimmed are skipped, unless [force]
+    is set. *)
+
+val run_many : string list -> string option -> string list -> string list -> bool -> int -> (string * bool * int64) option -> Tools_utils.key_store -> unit
+(** Sparsify several disks in place, up to [jobs] at a time,
+    and print a summary. *)
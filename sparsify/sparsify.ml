@@ -33,13 +33,17 @@ let rec main () =
   let cmdline = parse_cmdline () in
 
   (match cmdline.mode with
-  | Mode_copying (outdisk, check_tmpdir, compress, convert, option, tmp) ->
+  | Mode_copying (outdisk, check_tmpdir, compress, convert, option, tmp,
+                  convert_threads, out_of_order) ->
     Copying.run cmdline.indisk outdisk check_tmpdir compress convert
                 cmdline.format cmdline.ignores option tmp cmdline.zeroes
-                cmdline.ks
-  | Mode_in_place ->
-    In_place.run cmdline.indisk cmdline.format cmdline.ignores cmdline.zeroes
-                 cmdline.ks
+                convert_threads out_of_order cmdline.ks
+  | Mode_in_place ([disk], dryrun, _, state) ->
+    ignore (In_place.run disk cmdline.format cmdline.ignores cmdline.zeroes
+                         dryrun state cmdline.ks)
+  | Mode_in_place (disks, dryrun, jobs, state) ->
+    In_place.run_many disks cmdline.format cmdline.ignores cmdline.zeroes
+                      dryrun jobs state cmdline.ks
   )
 
 let () = run_main_and_handle_errors main
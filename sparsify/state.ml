@@ -0,0 +1,88 @@
+(* virt-sparsify
+ * Copyright (C) 2011-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(* Persistent state for incremental in-place sparsification. *)
+
+open Unix
+open Printf
+
+open Std_utils
+open Tools_utils
+open Common_gettext.Gettext
+
+type t = {
+  filename : string;
+  (* Map filesystem UUID (or device name) -> (free bytes, time). *)
+  filesystems : (string, int64 * float) Hashtbl.t;
+}
+
+let create ~directory disk =
+  (* The state file name is derived from the absolute path of the
+   * disk, so one state directory can be shared by many disks.
+   *)
+  let disk = absolute_path disk in
+  let filename = directory // Digest.to_hex (Digest.string disk) in
+  let filesystems = Hashtbl.create 13 in
+
+  if Sys.file_exists filename then (
+    let lines = read_whole_file filename in
+    let lines = String.nsplit "\n" lines in
+    List.iter (
+      fun line ->
+        if line <> "" && line.[0] <> '#' then (
+          try
+            Scanf.sscanf line "%s %Ld %f"
+              (fun id free t -> Hashtbl.replace filesystems id (free, t))
+          with Scanf.Scan_failure _ | Failure _ | End_of_file ->
+            warning (f_"%s: ignoring invalid line in state file: %s")
+                    filename line
+        )
+    ) lines
+  );
+  debug "state file %s for %s (%d entries)"
+        filename disk (Hashtbl.length filesystems);
+
+  { filename; filesystems }
+
+let find { filesystems } id =
+  Hashtbl.find_opt filesystems id
+
+let set ?(time = Unix.time ()) { filesystems } id free =
+  Hashtbl.replace filesystems id (free, time)
+
+let save { filename; filesystems } =
+  (* The directory is only created here, so that --dry-run creates
+   * nothing.
+   *)
+  let directory = Filename.dirname filename in
+  if not (is_directory directory) then
+    mkdir_p directory 0o755;
+
+  (* Write to a temporary file and rename, so that a crash or ^C
+   * cannot leave a truncated state file behind.
+   *)
+  let tmpfile = filename ^ ".tmp" in
+  with_open_out tmpfile (
+    fun chan ->
+      fprintf chan "# virt-sparsify --in-place state\n";
+      fprintf chan "# filesystem free-bytes last-trim-time\n";
+      Hashtbl.iter (
+        fun id (free, t) -> fprintf chan "%s %Ld %.0f\n" id free t
+      ) filesystems
+  );
+  rename tmpfile filename
@@ -0,0 +1,45 @@
+(* virt-sparsify
+ * Copyright (C) 2011-2025 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(** Persistent state for incremental in-place sparsification.
+
+    For each disk we record, per filesystem, how much free space it
+    had when it was last trimmed.  This lets [--state-dir] skip
+    filesystems whose free space has not grown since the last run. *)
+
+type t
+(** The state of a single disk. *)
+
+val create : directory:string -> string -> t
+(** [create ~directory disk] loads the state for [disk] from the
+    state directory, or returns an empty state if there is none. *)
+
+val find : t -> string -> (int64 * float) option
+(** [find t fs] returns the free space and time recorded when the
+    filesystem [fs] (usually identified by its UUID) was last
+    trimmed. *)
+
+val set : ?time:float -> t -> string -> int64 -> unit
+(** [set t fs free] records that [fs] was trimmed just now, and had
+    [free] bytes of free space.  [?time] overrides the time of the
+    trim, to lower the free space recorded for a skipped filesystem
+    without pretending that it was trimmed. *)
+
+val save : t -> unit
+(** Write the state back to the state directory, creating the
+    directory if it does not exist. *)
@@ -0,0 +1,82 @@
+#!/bin/bash -
+# libguestfs virt-sparsify --in-place test script
+# Copyright (C) 2026 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Test sparsifying several disks in place in parallel.
+
+source ../tests/functions.sh
+set -e
+set -x
+
+skip_if_skipped
+
+d1=test-virt-sparsify-in-place-jobs-1.img
+d2=test-virt-sparsify-in-place-jobs-2.img
+link=test-virt-sparsify-in-place-jobs-link.img
+rm -f $d1 $d2 $link
+
+for d in $d1 $d2; do
+    $VG guestfish -N $d=fs:ext4:100M <<EOF
+mount /dev/sda1 /
+fill 1 50M /big
+sync
+rm /big
+umount-all
+EOF
+done
+
+# The same disk given twice, even through a symlink, must be rejected
+# before anything is done to it.
+ln -s $d1 $link
+if $VG virt-sparsify --in-place --format raw $d1 $link; then
+    echo "$0: error: the same disk given twice was not rejected"
+    exit 1
+fi
+rm $link
+
+size1_before=$(du -s $d1 | awk '{print $1}')
+size2_before=$(du -s $d2 | awk '{print $1}')
+
+output="$($VG virt-sparsify --in-place -j 2 --format raw $d1 $d2)" || {
+    if [ "$?" -eq 3 ]; then
+        rm $d1 $d2
+        echo "$0: discard not supported in virt-sparsify"
+        exit 77
+    fi
+    exit 1
+}
+echo "$output"
+
+# The summary lists each disk in the order given, then the total.
+if [ "$(echo "$output" | grep ": reclaimable " | grep -v "^Total" | cut -d: -f1)" != "$d1
+$d2" ]; then
+    echo "$0: error: unexpected summary"
+    exit 1
+fi
+echo "$output" | grep "^Total: 2 disks, 0 failed, reclaimable .*, deallocated "
+
+size1_after=$(du -s $d1 | awk '{print $1}')
+size2_after=$(du -s $d2 | awk '{print $1}')
+
+# Both disks must have lost most of the 50 MB which was deleted.
+if [ $((size1_before-size1_after)) -le 40000 ] ||
+   [ $((size2_before-size2_after)) -le 40000 ]; then
+    echo "$0: error: disks were not sparsified"
+    exit 1
+fi
+
+rm $d1 $d2
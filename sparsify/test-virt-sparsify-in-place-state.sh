@@ -0,0 +1,110 @@
+#!/bin/bash -
+# libguestfs virt-sparsify --in-place test script
+# Copyright (C) 2026 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Test incremental in-place sparsification with --state-dir.
+
+source ../tests/functions.sh
+set -e
+set -x
+
+skip_if_skipped
+
+disk=test-virt-sparsify-in-place-state.img
+statedir=test-virt-sparsify-in-place-state.d
+rm -rf $disk $statedir
+
+$VG guestfish -N $disk=fs:ext4:200M <<EOF
+mount /dev/sda1 /
+fill 1 60M /keep
+fill 1 50M /big
+sync
+rm /big
+umount-all
+EOF
+
+sparsify ()
+{
+    $VG virt-sparsify --in-place --format raw --state-dir $statedir \
+        "$@" $disk > sparsify.out 2>&1 || {
+        r=$?
+        cat sparsify.out
+        if [ $r -eq 3 ]; then
+            rm -rf $disk $statedir sparsify.out
+            echo "$0: discard not supported in virt-sparsify"
+            exit 77
+        fi
+        exit 1
+    }
+    cat sparsify.out
+}
+
+# --dry-run must not create the state directory.
+sparsify --dry-run
+if [ -e $statedir ]; then
+    echo "$0: error: --dry-run created the state directory"
+    exit 1
+fi
+
+# The first run trims the filesystem and records it in a state file.
+sparsify
+if grep "Skipping" sparsify.out; then
+    echo "$0: error: filesystem skipped on the first run"
+    exit 1
+fi
+if [ "$(ls $statedir | wc -l)" -ne 1 ] ||
+   [ "$(grep -vc '^#' $statedir/*)" -ne 1 ]; then
+    echo "$0: error: state file was not written"
+    exit 1
+fi
+
+# Nothing has changed, so the second run skips it ...
+sparsify
+grep "Skipping /dev/sda" sparsify.out
+
+# ... unless --force is used.
+sparsify --force
+if grep "Skipping" sparsify.out; then
+    echo "$0: error: filesystem skipped with --force"
+    exit 1
+fi
+
+# Writing 40 MB lowers the free space, and the skipped run must
+# remember that, so that deleting the file again counts as growth.
+guestfish -a $disk --format=raw -m /dev/sda1 fill 1 40M /tmpfill
+sparsify
+grep "Skipping /dev/sda" sparsify.out
+guestfish -a $disk --format=raw -m /dev/sda1 rm /tmpfill
+sparsify
+if grep "Skipping" sparsify.out; then
+    echo "$0: error: space freed after the last trim was not trimmed"
+    exit 1
+fi
+
+# Free 60 MB.  This is below a 100 MB threshold but above 10 MB.
+guestfish -a $disk --format=raw -m /dev/sda1 rm /keep
+
+sparsify --trim-threshold 100
+grep "Skipping /dev/sda" sparsify.out
+
+sparsify --trim-threshold 10
+if grep "Skipping" sparsify.out; then
+    echo "$0: error: filesystem skipped although free space grew"
+    exit 1
+fi
+
+rm -r $disk $statedir sparsify.out
@@ -42,7 +42,47 @@ EOF
 
 size_before=$(du -s test-virt-sparsify-in-place.img | awk '{print $1}')
 
-$VG virt-sparsify --debug-gc --in-place --format raw test-virt-sparsify-in-place.img || {
+# Convert a size printed by virt-sparsify (eg. "300.0M") to megabytes.
+megabytes ()
+{
+    awk '{ n = $1 + 0; u = substr ($1, length ($1));
+           if (u == "K") n /= 1024; else if (u == "G") n *= 1024;
+           else if (u != "M") n /= 1048576;
+           printf "%.1f\n", n }' <<<"$1"
+}
+
+# A dry run must report the reclaimable space without changing the disk.
+output="$($VG virt-sparsify --debug-gc --in-place --dry-run --format raw \
+    test-virt-sparsify-in-place.img)"
+echo "$output"
+
+size_dryrun=$(du -s test-virt-sparsify-in-place.img | awk '{print $1}')
+
+if [ $size_dryrun -ne $size_before ]; then
+    echo "test virt-sparsify --in-place --dry-run: disk was modified"
+    exit 1
+fi
+
+# The 300 MB deleted from the LV and the 10 MB deleted from /boot must
+# be counted, and the total must be the sum of the figures above it
+# (give or take rounding).
+lv=$(echo "$output" | sed -n 's,.*/dev/VG/LV: \([^ ]*\) may be reclaimed.*,\1,p')
+total=$(echo "$output" | sed -n 's,.*Total space which may be reclaimed: \([^ ]*\).*,\1,p')
+sum=$(echo "$output" | sed -n 's,.*: \([^ ]*\) may be reclaimed.*,\1,p' |
+      while read n; do megabytes "$n"; done | awk '{ s += $1 } END { print s }')
+if [ -z "$lv" ] || [ -z "$total" ] ||
+   ! awk -v lv=$(megabytes "$lv") -v total=$(megabytes "$total") -v sum="$sum" \
+       'BEGIN { exit !(lv >= 300 && total >= 310 &&
+                       sum - total < 1 && total - sum < 1) }'; then
+    echo "test virt-sparsify --in-place --dry-run: unexpected figures"
+    exit 1
+fi
+if echo "$output" | grep "Deallocated"; then
+    echo "test virt-sparsify --in-place --dry-run: deallocated space reported"
+    exit 1
+fi
+
+output="$($VG virt-sparsify --debug-gc --in-place --format raw test-virt-sparsify-in-place.img)" || {
     if [ "$?" -eq 3 ]; then
         rm test-virt-sparsify-in-place.img
         echo "$0: discard not supported in virt-sparsify"
@@ -50,6 +90,10 @@ $VG virt-sparsify --debug-gc --in-place --format raw test-virt-sparsify-in-place
     fi
     exit 1
 }
+echo "$output"
+
+# A real run also reports what was deallocated on the host.
+echo "$output" | grep "Deallocated .* on the host (allocation .* -> .*)"
 
 size_after=$(du -s test-virt-sparsify-in-place.img | awk '{print $1}')
 
@@ -58,4 +58,14 @@ if [ $size_after -gt 15000 ]; then
     exit 1
 fi
 
+# The output tuning options must be passed on to qemu-img convert.
+$VG virt-sparsify -v --format raw test-virt-sparsify-1.img \
+    --convert qcow2 --cluster-size 65536 --convert-threads 4 -W \
+    test-virt-sparsify-3.img 2> test-virt-sparsify.log
+
+grep -E "qemu-img convert -f qcow2 -O '?qcow2'? -o '?cluster_size=65536'? -m 4 -W " \
+    test-virt-sparsify.log
+qemu-img info test-virt-sparsify-3.img | grep "^cluster_size: 65536$"
+
 rm test-virt-sparsify-1.img test-virt-sparsify-2.img
+rm test-virt-sparsify-3.img test-virt-sparsify.log
@@ -21,6 +21,7 @@
 open Printf
 
 open Std_utils
+open Tools_utils
 
 module G = Guestfs
 
@@ -37,3 +38,30 @@ let is_read_only_lv (g : G.guestfs) =
       List.exists (fun u -> compare_lvm2_uuids uuid u = 0) ro_uuids
     )
     else false
+
+(* Return the number of bytes allocated on the host for a disk image,
+ * or [None] if this cannot be determined (eg. for block devices).
+ * This is used to report how much space was actually deallocated.
+ *)
+let allocated_size disk =
+  if not (is_regular_file disk) then None
+  else (
+    let cmd = sprintf "du --block-size=1 -s -- %s" (quote disk) in
+    match external_command cmd with
+    | line :: _ ->
+       (match String.split "\t" line with
+        | size, _ -> (try Some (Int64.of_string size) with Failure _ -> None))
+    | [] -> None
+  )
+
+(* Return the number of free bytes in the filesystem mounted on [mp]. *)
+let free_bytes (g : G.guestfs) mp =
+  let { G.bsize; bfree } = g#statvfs mp in
+  bsize *^ bfree
+
+(* Format a time (as returned by [Unix.time]) for messages. *)
+let string_of_time t =
+  let tm = Unix.localtime t in
+  sprintf "%04d-%02d-%02d %02d:%02d:%02d"
+          (tm.Unix.tm_year + 1900) (tm.Unix.tm_mon + 1) tm.Unix.tm_mday
+          tm.Unix.tm_hour tm.Unix.tm_min tm.Unix.tm_sec
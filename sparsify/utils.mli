@@ -20,3 +20,14 @@
 
 val is_read_only_lv : Guestfs.guestfs -> string -> bool
 (* Return true if the filesystem is a read-only LV (RHBZ#1185561). *)
+
+val allocated_size : string -> int64 option
+(** Return the number of bytes allocated on the host for the disk image,
+    or [None] if this cannot be determined (eg. for block devices). *)
+
+val free_bytes : Guestfs.guestfs -> string -> int64
+(** Return the number of free bytes in the filesystem mounted
+    at the given mountpoint. *)
+
+val string_of_time : float -> string
+(** Format a time (as returned by [Unix.time]) for messages. *)
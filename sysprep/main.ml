@@ -36,8 +36,53 @@ let () = Sysprep_operation.bake ()
 
 let () = Random.self_init ()
 
+(* Print the statistics collected for each operation.  In dry run
+ * and verbose mode this is a table for humans.  With
+ * --machine-readable it is a JSON document.
+ *)
+let print_stats dryrun =
+  let stats = Sysprep_operation.get_stats () in
+
+  (* With --machine-readable the statistics are printed as JSON
+   * instead, which may also go to stdout.
+   *)
+  if (dryrun || verbose ()) && not (quiet ()) &&
+     machine_readable () = None then (
+    printf "%-28s %10s %8s %8s %12s\n"
+           (s_"Operation") (s_"Time (s)") (s_"Calls") (s_"Files")
+           (s_"Size");
+    List.iter (
+      fun { stats_name; stats_time; stats_calls; stats_files; stats_bytes } ->
+        printf "%-28s %10.2f %8d %8d %12s\n"
+               stats_name stats_time stats_calls stats_files
+               (human_size stats_bytes)
+    ) stats;
+    printf "%!"
+  );
+
+  match machine_readable () with
+  | None -> ()
+  | Some { pr } ->
+    let json_stats =
+      List.map (
+        fun { stats_name; stats_time; stats_calls; stats_files;
+              stats_bytes } ->
+          JSON.Dict [
+            "name", JSON.String stats_name;
+            "time-ms", JSON.Int (Int64.of_float (stats_time *. 1000.));
+            "calls", JSON.Int (Int64.of_int stats_calls);
+            "files-removed", JSON.Int (Int64.of_int stats_files);
+            "bytes-removed", JSON.Int stats_bytes;
+          ]
+      ) stats in
+    let doc = [
+      "dry-run", JSON.Bool dryrun;
+      "operations", JSON.List json_stats;
+    ] in
+    pr "%s\n" (JSON.string_of_doc ~fmt:JSON.Indented doc)
+
 let main () =
-  let operations, g, mount_opts, ks =
+  let operations, g, mount_opts, ks, dryrun =
     let domain = ref None in
     let dryrun = ref false in
     let files = ref [] in
@@ -108,6 +153,9 @@ let main () =
              Sysprep_operation.remove_defaults_from_set opset
           | `Add "all" -> Sysprep_operation.add_all_to_set opset
           | `Remove "all" -> Sysprep_operation.remove_all_from_set opset
+          | `Add "per-clone" -> Sysprep_operation.add_per_clone_to_set opset
+          | `Remove "per-clone" ->
+             Sysprep_operation.remove_per_clone_from_set opset
           | `Add n | `Remove n ->
             let f = match op with
               | `Add n -> Sysprep_operation.add_to_set
@@ -150,9 +198,21 @@ A short summary of the options is given below.  For detailed help please
 read the man page virt-sysprep(1).
 ")
         prog in
-    let opthandle = create_standard_options args ~key_opts:true usage_msg in
+    let opthandle = create_standard_options args ~key_opts:true
+                      ~machine_readable:true usage_msg in
     Getopt.parse opthandle.getopt;
 
+    (* Machine-readable mode with no disks?  Print out some facts
+     * about what this binary supports.
+     *)
+    (match !files, !domain, machine_readable () with
+    | [], None, Some { pr } ->
+      pr "virt-sysprep\n";
+      pr "operation-stats\n";
+      exit 0
+    | _, _, _ -> ()
+    );
+
     if not !format_consumed then
       error (f_"--format parameter must appear before -a parameter");
 
@@ -219,7 +279,7 @@ read the man page virt-sysprep(1).
     add g dryrun;
     g#launch ();
 
-    operations, g, mount_opts, opthandle.ks in
+    operations, g, mount_opts, opthandle.ks, dryrun in
 
   (* Decrypt the disks. *)
   inspect_decrypt g ks;
@@ -259,6 +319,8 @@ read the man page virt-sysprep(1).
 
   (* Finish off. *)
   g#shutdown ();
-  g#close ()
+  g#close ();
+
+  print_stats dryrun
 
 let () = run_main_and_handle_errors main
@@ -28,12 +28,19 @@ object
   val mutable m_created_file = false
   val mutable m_changed_file = false
   val mutable m_update_system_ca_store = false
+  val mutable m_removed_files = 0
+  val mutable m_removed_bytes = 0L
   method created_file () = m_created_file <- true
   method get_created_file = m_created_file
   method changed_file () = m_changed_file <- true
   method get_changed_file = m_changed_file
   method update_system_ca_store () = m_update_system_ca_store <- true
   method get_update_system_ca_store = m_update_system_ca_store
+  method removed_files n bytes =
+    m_removed_files <- m_removed_files + n;
+    m_removed_bytes <- m_removed_bytes +^ bytes
+  method get_removed_files = m_removed_files
+  method get_removed_bytes = m_removed_bytes
 end
 
 class device_side_effects = object end
@@ -44,6 +51,7 @@ type operation = {
   order : int;
   name : string;
   enabled_by_default : bool;
+  per_clone : bool;
   heading : string;
   pod_description : string option;
   pod_notes : string option;
@@ -62,6 +70,7 @@ let defaults = {
   order = 0;
   name = "";
   enabled_by_default = false;
+  per_clone = false;
   heading = "";
   pod_description = None;
   pod_notes = None;
@@ -100,6 +109,13 @@ let add_defaults_to_set set =
 let add_all_to_set set =
   opset_of_oplist !all_operations
 
+let per_clone_operations () =
+  opset_of_oplist (List.filter (fun { per_clone } -> per_clone)
+                               !all_operations)
+
+let add_per_clone_to_set set =
+  OperationSet.union set (per_clone_operations ())
+
 let remove_from_set name set =
   let name_filter = fun { name = n } -> name = n in
   if List.exists name_filter !all_operations <> true then
@@ -112,6 +128,9 @@ let remove_defaults_from_set set =
 let remove_all_from_set set =
   empty_set
 
+let remove_per_clone_from_set set =
+  OperationSet.diff set (per_clone_operations ())
+
 let register_operation op =
   List.push_front op all_operations;
   if op.enabled_by_default then
@@ -190,6 +209,10 @@ let dump_pod () =
       if op.enabled_by_default then printf "*\n";
       printf "\n";
       printf "%s.\n\n" op.heading;
+      if op.per_clone then (
+        printf (f_"This operation is part of the C<per-clone> set.");
+        printf "\n\n"
+      );
       Option.iter (printf "%s\n\n") op.pod_description;
       Option.iter (fun notes ->
           printf "=head3 ";
@@ -275,6 +298,52 @@ let not_enabled_check_args ?operations () =
   let disabled_ops = OperationSet.diff all_ops enabled_ops in
   OperationSet.iter (fun op -> op.not_enabled_check_args ()) disabled_ops
 
+type stats = {
+  stats_name : string;
+  mutable stats_time : float;
+  mutable stats_calls : int;
+  mutable stats_files : int;
+  mutable stats_bytes : int64;
+}
+
+(* Statistics for each operation performed, most recent first.  If an
+ * operation is performed more than once (eg. on a multiboot guest)
+ * the figures are added together.
+ *)
+let stats = ref []
+
+let get_stats () = List.rev !stats
+
+let add_stats name time calls files bytes =
+  let s =
+    try List.find (fun { stats_name } -> stats_name = name) !stats
+    with Not_found ->
+      let s = { stats_name = name; stats_time = 0.; stats_calls = 0;
+                stats_files = 0; stats_bytes = 0L } in
+      List.push_front s stats;
+      s in
+  s.stats_time <- s.stats_time +. time;
+  s.stats_calls <- s.stats_calls + calls;
+  s.stats_files <- s.stats_files + files;
+  s.stats_bytes <- s.stats_bytes +^ bytes
+
+(* Run [fn], recording the time taken, the number of libguestfs
+ * calls made, and the files removed (from [get_removed]).
+ *)
+let with_stats (g : Guestfs.guestfs) name get_removed fn =
+  let calls = ref 0 in
+  let eh =
+    g#set_event_callback (fun _ _ _ _ -> incr calls) [Guestfs.EVENT_ENTER] in
+  let files, bytes = get_removed () in
+  let start_t = Unix.gettimeofday () in
+  Fun.protect ~finally:(fun () -> g#delete_event_callback eh) fn;
+  let time = Unix.gettimeofday () -. start_t in
+  let files', bytes' = get_removed () in
+  let files = files' - files and bytes = bytes' -^ bytes in
+  debug "%s: %.2f seconds, %d calls, removed %d files (%Ld bytes)"
+        name time !calls files bytes;
+  add_stats name time !calls files bytes
+
 let compare_operations { order = o1; name = n1 } { order = o2; name = n2 } =
   let i = compare o1 o2 in
   if i <> 0 then i else compare n1 n2
@@ -296,7 +365,9 @@ let perform_operations_on_filesystems ?operations g root
     function
     | { name; perform_on_filesystems = Some fn } ->
       message (f_"Performing %S ...") name;
-      fn g root side_effects
+      let get_removed () =
+        side_effects#get_removed_files, side_effects#get_removed_bytes in
+      with_stats g name get_removed (fun () -> fn g root side_effects)
     | { perform_on_filesystems = None } -> ()
   ) ops
 
@@ -317,6 +388,7 @@ let perform_operations_on_devices ?operations g root
     function
     | { name; perform_on_devices = Some fn } ->
       message (f_"Performing %S ...") name;
-      fn g root side_effects
+      let get_removed () = 0, 0L in
+      with_stats g name get_removed (fun () -> fn g root side_effects)
     | { perform_on_devices = None } -> ()
   ) ops
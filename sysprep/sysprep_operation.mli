@@ -25,6 +25,9 @@ class filesystem_side_effects : object
   method get_changed_file : bool
   method update_system_ca_store : unit -> unit
   method get_update_system_ca_store : bool
+  method removed_files : int -> int64 -> unit
+  method get_removed_files : int
+  method get_removed_bytes : int64
 end
 (** The callback should indicate if it has side effects by calling
     methods in this class. *)
@@ -56,6 +59,13 @@ type operation = {
   (** If true, then enabled by default when no [--enable] option is
       given on the command line. *)
 
+  per_clone : bool;
+  (** If true, the operation generates something unique (a random
+      UUID, random seed, etc.) in the guest, so it must be run again
+      on every clone of a prepared template.  Operations which only
+      remove things do not need this since the clones inherit the
+      result from the template.  Used for [--operations per-clone]. *)
+
   heading : string;
   (** One-line description, NO trailing period. *)
 
@@ -162,6 +172,10 @@ val add_defaults_to_set : set -> set
 val add_all_to_set : set -> set
 (** [add_all_to_set set] adds to [set] all the available operations. *)
 
+val add_per_clone_to_set : set -> set
+(** [add_per_clone_to_set set] adds to [set] all the operations
+    which must be run again on each clone (see [per_clone]). *)
+
 val remove_from_set : string -> set -> set
 (** [remove_from_set name set] remove the operation named [name] from [set].
 
@@ -176,10 +190,28 @@ val remove_all_from_set : set -> set
 (** [remove_all_from_set set] removes from [set] all the available
     operations. *)
 
+val remove_per_clone_from_set : set -> set
+(** [remove_per_clone_from_set set] removes from [set] all the
+    operations which must be run again on each clone. *)
+
 val not_enabled_check_args : ?operations:set -> unit -> unit
 (** Call [not_enabled_check_args] on all operations in the set
     which are {i not} enabled. *)
 
+type stats = {
+  stats_name : string;                  (** Operation name. *)
+  mutable stats_time : float;           (** Elapsed time (seconds). *)
+  mutable stats_calls : int;            (** Number of libguestfs calls. *)
+  mutable stats_files : int;            (** Regular files removed, including
+                                            those in removed directories. *)
+  mutable stats_bytes : int64;          (** Size of those files. *)
+}
+(** Statistics collected for each operation performed. *)
+
+val get_stats : unit -> stats list
+(** Return the statistics for the operations performed so far,
+    in the order they were first performed. *)
+
 val perform_operations_on_filesystems : ?operations:set -> Guestfs.guestfs -> string -> filesystem_side_effects -> unit
 (** Perform all operations, or the subset listed in the [operations] set. *)
 
@@ -18,16 +18,14 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
+open Utils
 
 module G = Guestfs
 
 let abrt_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = g#glob_expand "/var/spool/abrt/*" in
-    Array.iter (
-      fun path -> g#rm_rf path;
-    ) paths
+    rm_rf_globs g side_effects [ "/var/spool/abrt/*" ]
   )
 
 let op = {
@@ -18,6 +18,7 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
+open Utils
 
 module G = Guestfs
 
@@ -29,7 +30,7 @@ let globs = [
 let crash_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (fun glob -> Array.iter g#rm_rf (g#glob_expand glob)) globs
+    rm_rf_globs g side_effects globs
   )
 
 let op = {
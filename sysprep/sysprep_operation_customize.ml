@@ -40,6 +40,7 @@ let op = {
     order = 99;                         (* Run it after everything. *)
     name = "customize";
     enabled_by_default = true;
+    per_clone = true;                   (* Writes a new random seed. *)
     heading = s_"Customize the guest";
     pod_description = Some (s_"\
 Customize the guest by providing L<virt-customize(1)> options
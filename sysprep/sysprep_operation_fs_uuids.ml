@@ -18,6 +18,7 @@
 
 open Printf
 
+open Std_utils
 open Common_gettext.Gettext
 open Tools_utils
 
@@ -25,26 +26,94 @@ open Sysprep_operation
 
 module G = Guestfs
 
+(* How expensive changing the UUID is likely to be, depending on
+ * the filesystem type and features.  Where the filesystem supports
+ * a separate metadata UUID, only the superblock needs to be
+ * rewritten, otherwise every metadata block which embeds the UUID
+ * has to be rewritten.
+ *)
+type uuid_change = Superblock_only | Metadata_uuid | Full_rewrite
+
+let string_of_uuid_change = function
+  | Superblock_only -> s_"superblock only"
+  | Metadata_uuid -> s_"metadata UUID"
+  | Full_rewrite -> s_"full metadata rewrite"
+
+let uuid_change g dev = function
+  | "xfs" ->
+     (* XFS v5 filesystems store the UUID in every metadata block, but
+      * xfs_admin -U sets the meta_uuid feature so that only the
+      * superblock changes.  The version number is the low 4 bits of
+      * sb_versionnum (16 bit big endian, at offset 100).
+      *)
+     (try
+        let v = g#pread_device dev 2 100L in
+        if Char.code v.[1] land 0xf >= 5 then Metadata_uuid
+        else Superblock_only
+      with G.Error _ -> Superblock_only)
+  | "ext2" | "ext3" | "ext4" ->
+     (* With metadata_csum but not metadata_csum_seed, the UUID is
+      * part of every metadata checksum so tune2fs must rewrite them.
+      *)
+     (try
+        let features = List.assoc "Filesystem features" (g#tune2fs_l dev) in
+        let features = String.nsplit " " features in
+        if List.mem "metadata_csum" features &&
+           not (List.mem "metadata_csum_seed" features) then Full_rewrite
+        else if List.mem "metadata_csum_seed" features then Metadata_uuid
+        else Superblock_only
+      with G.Error _ | Not_found -> Superblock_only)
+  | "btrfs" ->
+     (* libguestfs uses btrfstune -U which rewrites every tree block.
+      * The faster btrfstune -m (metadata_uuid) is not available
+      * through the libguestfs API.
+      *)
+     Full_rewrite
+  | _ -> Superblock_only
+
 let rec fs_uuids_perform g root side_effects =
   let fses = g#list_filesystems () in
+
+  (* Time spent per filesystem type, for the summary. *)
+  let times = Hashtbl.create 13 in
+
   List.iter (function
   | _, "unknown" -> ()
   | dev, typ ->
     if not (is_btrfs_subvolume g dev) then (
       let new_uuid = uuidgen () in
-      try
+      let change = uuid_change g dev typ in
+      debug "fs-uuids: %s (%s): %s" dev typ (string_of_uuid_change change);
+      if change = Full_rewrite then
+        info (f_"Changing the UUID of %s (%s) requires rewriting all \
+                 filesystem metadata, this may take some time")
+             dev typ;
+      let start_t = Unix.gettimeofday () in
+      (try
         g#set_uuid dev new_uuid
       with
         G.Error msg ->
           warning (f_"cannot set random UUID on filesystem %s type %s: %s")
             dev typ msg
+      );
+      let t = Unix.gettimeofday () -. start_t in
+      let n, total = try Hashtbl.find times typ with Not_found -> 0, 0. in
+      Hashtbl.replace times typ (n+1, total +. t)
     )
-  ) fses
+  ) fses;
+
+  let times = Hashtbl.fold (fun typ v acc -> (typ, v) :: acc) times [] in
+  let times = List.sort compare times in
+  List.iter (
+    fun (typ, (n, total)) ->
+      debug "fs-uuids: %s: %d filesystem(s) in %.2f seconds" typ n total
+  ) times
 
 let op = {
   defaults with
     name = "fs-uuids";
     enabled_by_default = false;
+    per_clone = true;
     heading = s_"Change filesystem UUIDs";
     pod_description = Some (s_"\
 On guests and filesystem types where this is supported,
@@ -56,6 +125,12 @@ the UUIDs.  For example C</etc/fstab> or the bootloader.
 Enabling this operation is more likely than not to make your
 guest unbootable.
 
+On some filesystems changing the UUID is a slow operation which
+rewrites all the filesystem metadata, notably btrfs, and ext4 with
+the C<metadata_csum> feature but not C<metadata_csum_seed>.  A message
+is printed when this is the case.  XFS (version 5) and ext4 with
+C<metadata_csum_seed> only need to change the superblock.
+
 See: L<https://bugzilla.redhat.com/show_bug.cgi?id=991641>");
     perform_on_devices = Some fs_uuids_perform;
 }
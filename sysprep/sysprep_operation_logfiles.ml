@@ -137,7 +137,7 @@ let globs_as_pod = pod_of_list globs
 let logfiles_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (fun glob -> Array.iter g#rm_rf (g#glob_expand glob)) globs
+    rm_rf_globs g side_effects globs
   )
 
 let op = {
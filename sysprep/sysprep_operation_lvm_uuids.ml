@@ -81,6 +81,7 @@ let op = {
     order = 99; (* Run it after other block device ops. *)
     name = "lvm-uuids";
     enabled_by_default = true;
+    per_clone = true;
     heading = s_"Change LVM2 PV and VG UUIDs";
     pod_description = Some (s_"\
 On Linux guests that have LVM2 physical volumes (PVs) or volume groups (VGs),
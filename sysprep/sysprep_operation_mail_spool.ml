@@ -18,13 +18,12 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
+open Utils
 
 module G = Guestfs
 
 let mail_spool_perform (g : Guestfs.guestfs) root side_effects =
-  List.iter (
-    fun glob -> Array.iter g#rm_rf (g#glob_expand glob)
-  ) [
+  rm_rf_globs g side_effects [
     "/var/spool/mail/*";
     "/var/mail/*";
   ]
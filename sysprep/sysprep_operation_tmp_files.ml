@@ -18,29 +18,18 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
+open Utils
 
 module G = Guestfs
 
 let tmp_files_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/tmp";
-                  "/var/tmp"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand (path ^ "/*") in
-        Array.iter (
-          fun file ->
-            g#rm_rf file;
-        ) files;
-        (try
-          let files = g#ls path in
-          Array.iter (
-            fun file ->
-              g#rm_rf (path ^ "/" ^ file);
-          ) files
-        with G.Error _ -> ());
-    ) paths
+    (* Remove everything including dot files, with a single
+     * listing of each directory.
+     *)
+    rm_rf_globs g side_effects [ "/tmp/*"; "/tmp/.*";
+                                 "/var/tmp/*"; "/var/tmp/.*" ]
   )
 
 let op = {
@@ -57,42 +57,56 @@ let user_account_perform g root side_effects =
   let typ = g#inspect_get_type root in
   let changed = ref false in
   if typ <> "windows" then (
-    g#aug_init "/" 0;
+    (* Load only the lenses for the files we need, instead of
+     * letting Augeas parse every configuration file it knows about.
+     * 32 = AUG_NO_LOAD, 64 = AUG_NO_MODL_AUTOLOAD.
+     *)
+    g#aug_init "/" (32 + 64);
+    List.iter (
+      fun (lens, file) -> g#aug_transform lens file
+    ) [ "Login_defs.lns", "/etc/login.defs";
+        "Passwd.lns", "/etc/passwd";
+        "Shadow.lns", "/etc/shadow";
+        "Group.lns", "/etc/group" ];
+    g#aug_load ();
+
     let uid_min = g#aug_get "/files/etc/login.defs/UID_MIN" in
     let uid_min = int_of_string uid_min in
     let uid_max = g#aug_get "/files/etc/login.defs/UID_MAX" in
     let uid_max = int_of_string uid_max in
-    let users = Array.to_list (g#aug_ls "/files/etc/passwd") in
+
+    (* Read the passwd file in one go instead of making several Augeas
+     * calls per user.  Augeas is only used to remove entries.
+     *)
+    let users = g#read_lines "/etc/passwd" in
+    let users = Array.to_list users in
+    let users = List.filter_map (
+      fun line ->
+        match String.nsplit ":" line with
+        | username :: _ :: uid :: _ :: _ :: home :: _
+             when username <> "" && username.[0] <> '+' &&
+                  username.[0] <> '-' ->
+          (try Some (username, int_of_string uid, home)
+           with Failure _ -> None)
+        | _ -> None
+    ) users in
     List.iter (
-      fun userpath ->
-        let uid = userpath ^ "/uid" in
-        let uid = g#aug_get uid in
-        let uid = int_of_string uid in
-        let username =
-          match last_part_of userpath '/' with
-          | Some x -> x
-          | None -> error "user-accounts: missing '/' in %s" userpath in
+      fun (username, uid, home) ->
         if uid >= uid_min && uid <= uid_max
            && check_remove_user username then (
           changed := true;
-          (* Get the home before removing the passwd entry. *)
-          let home_dir =
-            try Some (g#aug_get (userpath ^ "/home"))
-            with _ ->
-              if verbose () then
-                warning (f_"Cannot get the home directory for %s")
-                  username;
-              None in
-          g#aug_rm userpath;
+          g#aug_rm (sprintf "/files/etc/passwd/%s" username);
           g#aug_rm (sprintf "/files/etc/shadow/%s" username);
           g#aug_rm (sprintf "/files/etc/group/%s" username);
           g#rm_rf ("/var/spool/mail/" ^ username);
-          match home_dir with
-          | None -> ()
-          | Some dir -> g#rm_rf dir
+          if home <> "" then
+            g#rm_rf home
+          else if verbose () then
+            warning (f_"Cannot get the home directory for %s") username
         )
     ) users;
     g#aug_save ();
+    g#aug_close ()
   );
   if !changed then
     side_effects#changed_file ()
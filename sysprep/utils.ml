@@ -20,9 +20,12 @@
 
 open Printf
 
+open Std_utils
 open Tools_utils
 open Common_gettext.Gettext
 
+module G = Guestfs
+
 let rec pod_of_list ?(style = `Dot) xs =
   match style with
   | `Verbatim -> String.concat "\n" (List.map ((^) " ") xs)
@@ -65,3 +68,122 @@ and update_system_ca_store_command g root =
     warning (f_"updating the system CA store on this guest %s/%s \
                 is not supported") typ distro;
     None
+
+(* Does a path element contain any glob metacharacters? *)
+let is_glob str =
+  String.contains str '*' || String.contains str '?' || String.contains str '['
+
+(* Convert the final path element of a glob pattern to a regular
+ * expression.  This only has to handle the subset of glob(7) used
+ * by the sysprep operations: [*], [?] and [[...]] classes.
+ *)
+let regexp_of_glob glob =
+  let buf = Buffer.create 32 in
+  let n = String.length glob in
+  let rec loop i =
+    if i < n then (
+      match glob.[i] with
+      | '*' -> Buffer.add_string buf ".*"; loop (i+1)
+      | '?' -> Buffer.add_char buf '.'; loop (i+1)
+      | '[' ->
+         (match String.index_from_opt glob i ']' with
+          | Some j when j > i+1 ->
+             let cls = String.sub glob (i+1) (j-i-1) in
+             let cls =
+               if cls.[0] = '!' then "^" ^ String.sub cls 1 (String.length cls - 1)
+               else cls in
+             Buffer.add_string buf ("[" ^ cls ^ "]");
+             loop (j+1)
+          | _ ->
+             Buffer.add_string buf (Str.quote "["); loop (i+1)
+         )
+      | c -> Buffer.add_string buf (Str.quote (String.make 1 c)); loop (i+1)
+    )
+  in
+  loop 0;
+  Buffer.add_char buf '$';
+  Str.regexp (Buffer.contents buf)
+
+let rm_rf_globs (g : G.guestfs) side_effects globs =
+  (* Group the patterns by parent directory.  Patterns which have
+   * wildcards in the directory part are expanded by the daemon
+   * as before, and the results added as literal names.
+   *)
+  let dirs = Hashtbl.create 13 in
+  let add dir pattern =
+    let patterns = try Hashtbl.find dirs dir with Not_found -> [] in
+    Hashtbl.replace dirs dir (pattern :: patterns)
+  in
+  List.iter (
+    fun glob ->
+      let dir = Filename.dirname glob and base = Filename.basename glob in
+      if is_glob dir then
+        Array.iter (
+          fun path -> add (Filename.dirname path) (`Name (Filename.basename path))
+        ) (g#glob_expand glob)
+      else if is_glob base then
+        add dir (`Glob (base, regexp_of_glob base))
+      else
+        add dir (`Name base)
+  ) globs;
+
+  (* Process the directories in order, so parents are handled before
+   * their subdirectories (which may therefore already be gone).
+   *)
+  let dirs = Hashtbl.fold (fun dir patterns acc -> (dir, patterns) :: acc)
+                          dirs [] in
+  let dirs = List.sort (fun (a, _) (b, _) -> compare a b) dirs in
+
+  List.iter (
+    fun (dir, patterns) ->
+      (* One listing of the directory replaces one glob_expand call
+       * per pattern.  If the directory does not exist there is
+       * nothing to remove.
+       *)
+      let names = try g#ls dir with G.Error _ -> [||] in
+      let names = Array.to_list names in
+      let matches name =
+        List.exists (
+          function
+          | `Name n -> n = name
+          | `Glob (glob, rex) ->
+             (* Like glob(3), don't match leading dots implicitly. *)
+             (name.[0] <> '.' || glob.[0] = '.') &&
+             Str.string_match rex name 0
+        ) patterns
+      in
+      let names = List.filter matches names in
+
+      if names <> [] then (
+        (* Count the regular files we remove and their sizes.  Matched
+         * directories are listed with g#find (which is recursive), so
+         * this takes one extra call per directory.
+         *)
+        let stat_names dir names =
+          try Array.to_list (g#lstatnslist dir names) with G.Error _ -> [] in
+        let is_type t { G.st_mode } = st_mode &^ 0o170000L = t in
+        let add_regular (files, bytes) st =
+          if is_type 0o100000L st then (files + 1, bytes +^ st.G.st_size)
+          else (files, bytes)
+        in
+        let stats =
+          let names' = Array.of_list names in
+          try List.combine names (stat_names dir names')
+          with Invalid_argument _ -> [] in
+        let files, bytes =
+          List.fold_left (
+            fun acc (name, st) ->
+              if is_type 0o040000L st then (
+                let subdir = dir // name in
+                match (try g#find subdir with G.Error _ -> [||]) with
+                | [||] -> acc
+                | subnames ->
+                   List.fold_left add_regular acc (stat_names subdir subnames)
+              )
+              else add_regular acc st
+          ) (0, 0L) stats in
+
+        List.iter (fun name -> g#rm_rf (dir // name)) names;
+        side_effects#removed_files files bytes
+      )
+  ) dirs
@@ -30,3 +30,13 @@ val pod_of_list : ?style:[`Verbatim|`Star|`Dash|`Dot] -> string list -> string
 val update_system_ca_store : Guestfs.guestfs -> string -> unit
 (** Update the system CA store on the guest for the specified root
     (which is fully mounted). *)
+
+val rm_rf_globs : Guestfs.guestfs -> < removed_files : int -> int64 -> unit; .. > -> string list -> unit
+(** [rm_rf_globs g side_effects globs] removes (as with [g#rm_rf])
+    everything matching the list of glob patterns.
+
+    Rather than calling [g#glob_expand] for each pattern, the patterns
+    are grouped by parent directory and each directory is listed once,
+    which saves a lot of round trips for long lists of patterns.  The
+    number of entries removed and the total size of the regular files
+    among them is reported to [side_effects]. *)
@@ -44,6 +44,8 @@
 #include "display-options.h"
 #include "windows.h"
 
+#include "mount-cache.h"
+
 /* Currently open libguestfs handle. */
 guestfs_h *g;
 
@@ -56,6 +58,8 @@ int inspector = 1;
 int in_guestfish = 0;
 int in_virt_rescue = 0;
 
+static const char *cache_dir = NULL;
+
 static int do_tail (int argc, char *argv[], struct drv *drvs, struct mp *mps, struct key_store *ks);
 static time_t disk_mtime (struct drv *drvs);
 static int reopen_handle (void);
@@ -76,6 +80,7 @@ usage (int status)
               "  -a|--add image       Add image\n"
               "  --blocksize[=512|4096]\n"
               "                       Set sector size of the disk for -a option\n"
+              "  --cache dir          Cache the guest's mountpoints in dir\n"
               "  -c|--connect uri     Specify libvirt URI for -d option\n"
               "  -d|--domain guest    Add disks from libvirt guest\n"
               "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -109,6 +114,7 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
     { "blocksize", 2, 0, 0 },
+    { "cache", 1, 0, 0 },
     { "connect", 1, 0, 'c' },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -161,6 +167,8 @@ main (int argc, char *argv[])
         OPTION_blocksize;
       } else if (STREQ (long_options[option_index].name, "key")) {
         OPTION_key;
+      } else if (STREQ (long_options[option_index].name, "cache")) {
+        cache_dir = optarg;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -267,6 +275,7 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
   int first_iteration = 1;
   int prev_file_displayed = -1;
   CLEANUP_FREE struct follow *file = NULL;
+  CLEANUP_FREE char *cache_file = NULL;
 
   /* Allocate storage to track each file. */
   file = calloc (argc, sizeof (struct follow));
@@ -285,12 +294,20 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
   if (drvt == (time_t)-1)
     return -1;
 
+  /* With --cache, the cache file is chosen once here, so when the
+   * handle is reopened below because the disks changed, the guest is
+   * not inspected again.
+   */
+  if (cache_dir && mps == NULL && ks == NULL)
+    cache_file = mount_cache_filename (cache_dir, drvs);
+
   while (!quit) {
     time_t t;
     int i;
     int windows = 0;
     char *root;
     CLEANUP_FREE_STRING_LIST char **roots = NULL;
+    CLEANUP_FREE char *type = NULL;
     int processed;
 
     /* Add drives, inspect and mount. */
@@ -304,10 +321,15 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
 
     if (mps != NULL)
       mount_mps (mps);
-    else
+    else if (cache_file == NULL ||
+             (type = mount_from_cache (cache_file)) == NULL) {
       inspect_mount ();
+      if (cache_file)
+        mount_cache_save (cache_file);
+    }
 
-    if (inspector) {
+    /* Windows guests are never cached, see mount-cache.c. */
+    if (inspector && type == NULL) {
       /* Get root mountpoint.  See: fish/inspect.c:inspect_mount */
       roots = guestfs_inspect_get_roots (g);
 